@@ -0,0 +1,374 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/interrupt.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+#include "address_map_arm.h"
+#include "interrupt_ID.h"
+#include "timer_interface.h"
+#include "adc_interface.h"
+#include "adc_ring.h"
+
+#define SUCCESS 0
+#define ADC_DEVICE_NAME "adc"
+#define MAX_SIZE 64
+#define ADC_DEFAULT_RATE 20000
+#define ADC_MAX_RATE 50000
+#define ADC_DEFAULT_MASK 0x01
+#define ADC_ALL_CHANNELS 0xFF
+#define ADC_WAKES_PER_SEC 1000 // readers are woken about once a millisecond
+
+/* Kernel character device driver for the ADC controller. The controller
+ * converts every channel continuously; interval timer 1 interrupts at the
+ * sample rate and the handler copies the enabled channels, with a
+ * timestamp, into an adc_ring. Clients read() whole adc_scan records, or
+ * mmap() the ring and consume it directly, and poll() for data.
+ * Commands written to the device:
+ *   "rate <scans per second>"   1 to ADC_MAX_RATE
+ *   "channels <hex mask>"       bit n enables channel n
+ *   "start" / "stop"
+ * /sys/class/adc/adc/status reports the settings and the ring state.
+ */
+
+static int adc_device_open (struct inode *, struct file *);
+static int adc_device_release (struct inode *, struct file *);
+static ssize_t adc_device_read (struct file *, char *, size_t, loff_t *);
+static ssize_t adc_device_write(struct file *filp, const char *buffer, size_t length, loff_t *offset);
+static unsigned int adc_device_poll(struct file *, poll_table *);
+static int adc_device_mmap(struct file *, struct vm_area_struct *);
+static ssize_t status_show(struct device *, struct device_attribute *, char *);
+
+static dev_t adc_dev_no = 0;
+static struct cdev *adc_cdev = NULL;
+static struct class *adc_class = NULL;
+static struct device *adc_device = NULL;
+static char adc_msg[MAX_SIZE];
+
+static DEVICE_ATTR_RO(status);
+
+static struct file_operations adc_fops = {
+	.owner = THIS_MODULE,
+	.read = adc_device_read,
+	.write = adc_device_write,
+	.poll = adc_device_poll,
+	.mmap = adc_device_mmap,
+	.open = adc_device_open,
+	.release = adc_device_release
+};
+
+irq_handler_t adc_irq_handler(int irq, void *dev_id, struct pt_regs *regs);
+void start_sampling(void);
+void stop_sampling(void);
+int set_rate(unsigned int rate);
+int set_channels(unsigned int mask);
+
+void* LW_virtual;
+volatile unsigned int* adc_ptr;
+volatile unsigned int* timer_ptr;
+static adc_ring* ring = NULL;
+
+static bool sampling = false;
+static unsigned int n_scans = 0; // index of the next scan
+static unsigned int wake_every = 1; // scans between reader wake ups
+static unsigned int wake_count = 0;
+
+// Readers sleep here until the interrupt has produced scans
+static DECLARE_WAIT_QUEUE_HEAD(adc_wait);
+// One consumer at a time: the ring is single consumer
+static DEFINE_MUTEX(adc_open_mutex);
+static bool adc_in_use = false;
+
+static int __init start_driver(void)
+{
+	int err = 0;
+
+	ring = vmalloc_user(PAGE_ALIGN(sizeof(adc_ring)));
+	if (ring == NULL)
+		return -ENOMEM;
+
+	LW_virtual = ioremap_nocache(LW_BRIDGE_BASE, LW_BRIDGE_SPAN);
+	adc_ptr = LW_virtual + ADC_BASE;
+	timer_ptr = LW_virtual + TIMER1_BASE;
+
+	// The timer stays off until a client starts sampling
+	*(timer_ptr + TMR_CONTROL) = TMR_STOP;
+	*(timer_ptr + TMR_STATUS) = 0;
+	ring->channel_mask = ADC_DEFAULT_MASK;
+	set_rate(ADC_DEFAULT_RATE);
+
+	/* Get a device number. Get one minor number (0) */
+	if ((err = alloc_chrdev_region (&adc_dev_no, 0, 1, ADC_DEVICE_NAME)) < 0) {
+		printk (KERN_ERR "adc: alloc_chrdev_region() failed with return value %d\n", err);
+		return err;
+	}
+
+	// Allocate and initialize the character device
+	adc_cdev = cdev_alloc ();
+	adc_cdev->ops = &adc_fops;
+	adc_cdev->owner = THIS_MODULE;
+
+	// Add the character device to the kernel
+	if ((err = cdev_add (adc_cdev, adc_dev_no, 1)) < 0) {
+		printk (KERN_ERR "adc: cdev_add() failed with return value %d\n", err);
+		return err;
+	}
+
+	adc_class = class_create (THIS_MODULE, ADC_DEVICE_NAME);
+	adc_device = device_create (adc_class, NULL, adc_dev_no, NULL, ADC_DEVICE_NAME );
+	if ((err = device_create_file (adc_device, &dev_attr_status)) < 0)
+		printk (KERN_ERR "adc: device_create_file() failed with return value %d\n", err);
+
+	// Register the interrupt handler for the sampling timer
+	err = request_irq (TIMER1_IRQ, (irq_handler_t) adc_irq_handler, IRQF_TIMER,
+		"adc_irq_handler", (void *) (adc_irq_handler));
+
+	return err;
+}
+
+static void __exit stop_driver(void)
+{
+	stop_sampling();
+	free_irq (TIMER1_IRQ, (void*) adc_irq_handler);
+	iounmap (LW_virtual);
+	vfree (ring);
+	device_remove_file (adc_device, &dev_attr_status);
+	device_destroy (adc_class, adc_dev_no);
+	cdev_del (adc_cdev);
+	class_destroy (adc_class);
+	unregister_chrdev_region (adc_dev_no, 1);
+}
+
+// Takes one scan of the enabled channels. The controller is converting
+// continuously, so the registers always hold the latest conversions.
+irq_handler_t adc_irq_handler(int irq, void *dev_id, struct pt_regs *regs)
+{
+	adc_scan* scan = NULL;
+	unsigned int mask = ring->channel_mask;
+	int channel = 0;
+
+	*(timer_ptr + TMR_STATUS) = 0;
+
+	scan = adc_ring_next(ring);
+	if (scan == NULL)
+	{
+		ring->overruns++;
+		n_scans++;
+		return (irq_handler_t) IRQ_HANDLED;
+	}
+
+	scan->timestamp_ns = ktime_get_ns();
+	scan->index = n_scans++;
+	scan->channel_mask = mask;
+	for (channel = 0; channel < ADC_CHANNELS; channel++)
+	{
+		if (mask & (1 << channel))
+			scan->values[channel] = *(adc_ptr + channel) & ADC_DATA_MASK;
+		else
+			scan->values[channel] = 0;
+	}
+	adc_ring_produce(ring);
+
+	// Waking readers on every scan would cost more than the scan itself
+	if (++wake_count >= wake_every)
+	{
+		wake_count = 0;
+		wake_up_interruptible(&adc_wait);
+	}
+
+	return (irq_handler_t) IRQ_HANDLED;
+}
+
+void start_sampling(void)
+{
+	n_scans = 0;
+	wake_count = 0;
+	*(adc_ptr + ADC_AUTO_UPDATE) = 1;
+	*(timer_ptr + TMR_STATUS) = 0;
+	*(timer_ptr + TMR_CONTROL) = TMR_ITO | TMR_CONT | TMR_START;
+	sampling = true;
+}
+
+void stop_sampling(void)
+{
+	*(timer_ptr + TMR_CONTROL) = TMR_STOP;
+	*(timer_ptr + TMR_STATUS) = 0;
+	*(adc_ptr + ADC_AUTO_UPDATE) = 0;
+	sampling = false;
+	// Readers waiting on an empty ring see the end of the capture
+	wake_up_interruptible(&adc_wait);
+}
+
+// Reprograms the timer period, restarting it if it was running
+int set_rate(unsigned int rate)
+{
+	unsigned int period = 0;
+
+	if (rate == 0 || rate > ADC_MAX_RATE)
+		return -EINVAL;
+
+	period = TMR_CLOCK_HZ / rate - 1;
+	*(timer_ptr + TMR_CONTROL) = TMR_STOP;
+	*(timer_ptr + TMR_SVAL_LOW) = period & 0xFFFF;
+	*(timer_ptr + TMR_SVAL_HIGH) = period >> 16;
+	ring->rate = rate;
+	wake_every = rate / ADC_WAKES_PER_SEC ? rate / ADC_WAKES_PER_SEC : 1;
+
+	if (sampling)
+		*(timer_ptr + TMR_CONTROL) = TMR_ITO | TMR_CONT | TMR_START;
+	return 0;
+}
+
+// Takes effect from the next scan
+int set_channels(unsigned int mask)
+{
+	if (mask == 0 || mask > ADC_ALL_CHANNELS)
+		return -EINVAL;
+
+	WRITE_ONCE(ring->channel_mask, mask);
+	return 0;
+}
+
+/* Called when a process opens adc. Empties the ring; sampling waits for
+ * the "start" command. */
+static int adc_device_open(struct inode *inode, struct file *file)
+{
+	mutex_lock(&adc_open_mutex);
+	if (adc_in_use)
+	{
+		mutex_unlock(&adc_open_mutex);
+		return -EBUSY;
+	}
+	adc_in_use = true;
+	mutex_unlock(&adc_open_mutex);
+
+	ring->head = 0;
+	ring->tail = 0;
+	ring->overruns = 0;
+
+	return SUCCESS;
+}
+
+/* Called when a process closes adc. Stops sampling. */
+static int adc_device_release(struct inode *inode, struct file *file)
+{
+	stop_sampling();
+
+	mutex_lock(&adc_open_mutex);
+	adc_in_use = false;
+	mutex_unlock(&adc_open_mutex);
+
+	return 0;
+}
+
+/* Called when a process reads from adc. Copies whole adc_scan records,
+ * sleeping while the ring is empty unless the file is non-blocking.
+ * Returns the number of bytes read, or 0 once sampling has stopped and
+ * every scan has been read. */
+static ssize_t adc_device_read(struct file *filp, char *buffer, size_t length, loff_t *offset)
+{
+	size_t scans = length / sizeof(adc_scan);
+	size_t copied = 0;
+	adc_scan* region = NULL;
+	unsigned int n = 0;
+
+	if (scans == 0)
+		return -EINVAL;
+
+	while (copied < scans)
+	{
+		if (adc_ring_count(ring) == 0)
+		{
+			if (copied || !sampling)
+				break;
+			if (filp->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+			if (wait_event_interruptible(adc_wait, adc_ring_count(ring) > 0 || !sampling))
+				return -ERESTARTSYS;
+			continue;
+		}
+
+		region = adc_ring_read_region(ring, &n);
+		if (n > scans - copied)
+			n = scans - copied;
+		if (copy_to_user (buffer + copied * sizeof(adc_scan), region, n * sizeof(adc_scan)) != 0)
+			return copied ? copied * sizeof(adc_scan) : -EFAULT;
+		adc_ring_consume(ring, n);
+		copied += n;
+	}
+
+	return copied * sizeof(adc_scan);
+}
+
+/* Called when a process writes to adc. Runs one command. Returns the
+ * number of bytes written, or -EINVAL for an unknown or invalid command. */
+static ssize_t adc_device_write(struct file *filp, const char *buffer, size_t length, loff_t *offset)
+{
+	size_t bytes = length;
+	unsigned int value = 0;
+	int err = 0;
+
+	if (bytes == 0)
+		return 0;
+	if (bytes > MAX_SIZE - 1)
+		bytes = MAX_SIZE - 1;
+
+	if (copy_from_user (adc_msg, buffer, bytes) != 0)
+		return -EFAULT;
+	adc_msg[bytes] = '\0';
+	if (adc_msg[bytes-1] == '\n')
+		adc_msg[bytes-1] = '\0';
+
+	if (!strcmp(adc_msg, "start"))
+		start_sampling();
+	else if (!strcmp(adc_msg, "stop"))
+		stop_sampling();
+	else if (!strncmp(adc_msg, "rate ", 5))
+		err = kstrtouint(adc_msg + 5, 10, &value) ? -EINVAL : set_rate(value);
+	else if (!strncmp(adc_msg, "channels ", 9))
+		err = kstrtouint(adc_msg + 9, 16, &value) ? -EINVAL : set_channels(value);
+	else
+		err = -EINVAL;
+
+	return err ? err : length;
+}
+
+static unsigned int adc_device_poll(struct file *filp, poll_table *wait)
+{
+	poll_wait(filp, &adc_wait, wait);
+
+	if (adc_ring_count(ring) > 0)
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+// Maps the whole adc_ring: the client reads scans and advances tail
+// itself, exactly like adc_ring_read_region/adc_ring_consume.
+static int adc_device_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	if (vma->vm_end - vma->vm_start > PAGE_ALIGN(sizeof(adc_ring)))
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring, vma->vm_pgoff);
+}
+
+static ssize_t status_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE,
+		"rate %u\nchannels %02x\nsampling %d\nscans %u\nqueued %u\noverruns %u\n",
+		ring->rate, ring->channel_mask, sampling, n_scans,
+		adc_ring_count(ring), ring->overruns);
+}
+
+MODULE_LICENSE("GPL");
+module_init (start_driver);
+module_exit (stop_driver);
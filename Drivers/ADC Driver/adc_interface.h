@@ -0,0 +1,14 @@
+//Defines the offsets and bits for the ADC controller interface
+
+#define ADC_CHANNELS     8        // one register per channel, at word offsets 0 to 7
+#define ADC_UPDATE       0x00     // write: convert every channel once
+#define ADC_AUTO_UPDATE  0x01     // write 1: convert every channel continuously
+#define ADC_DATA_MASK    0xFFF    // 12-bit conversions
+#define ADC_MAX_VALUE    4095
+
+// TMR_CONTROL bits of the interval timer that paces the sampling
+#define TMR_ITO          0x01     // interrupt on timeout
+#define TMR_CONT         0x02     // reload and keep counting
+#define TMR_START        0x04
+#define TMR_STOP         0x08
+#define TMR_CLOCK_HZ     100000000 // the interval timers count at 100 MHz
@@ -0,0 +1,89 @@
+#ifndef _ADC_RING_
+#define _ADC_RING_
+
+/* Single producer, single consumer ring of timestamped ADC scans. The
+ * producer is the sampling interrupt; the consumer is read() or a process
+ * that mmap()ed the ring. Only the producer writes head and only the
+ * consumer writes tail, so neither side takes a lock. Both indexes run
+ * freely and wrap at 2^32. When the ring is full new scans are dropped and
+ * counted in overruns; the gap also shows in the scan indexes.
+ *
+ * Header only, so user space can consume the mmap()ed ring with the same
+ * functions the driver uses.
+ */
+
+#define ADC_RING_SCANS 16384 // must be a power of two, over 0.3 s at 50 kHz
+#define ADC_RING_CHANNELS 8
+
+#ifdef __KERNEL__
+#include <asm/barrier.h>
+#define ring_load_acquire(p) smp_load_acquire(p)
+#define ring_store_release(p, v) smp_store_release(p, v)
+#else
+#define ring_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ring_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+// One conversion of the enabled channels, 32 bytes. Disabled channels read 0.
+typedef struct adc_scan
+{
+	unsigned long long timestamp_ns; // CLOCK_MONOTONIC when the scan was taken
+	unsigned int index; // scans since sampling started, including dropped ones
+	unsigned short channel_mask; // channels sampled in this scan
+	unsigned short reserved;
+	unsigned short values[ADC_RING_CHANNELS];
+} adc_scan;
+
+// Shared with user space through mmap(): keep the layout fixed.
+typedef struct adc_ring
+{
+	unsigned int head; // next scan the producer fills
+	unsigned int tail; // next scan the consumer reads
+	unsigned int overruns; // scans dropped because the ring was full
+	unsigned int rate; // scans per second
+	unsigned int channel_mask;
+	unsigned int reserved[3];
+	adc_scan scans[ADC_RING_SCANS];
+} adc_ring;
+
+// Scans waiting to be read. Head is re-read with acquire, so the scans it
+// covers are visible.
+static inline unsigned int adc_ring_count(adc_ring* ring)
+{
+	return ring_load_acquire(&ring->head) - ring->tail;
+}
+
+// Producer side: the slot for the next scan, or NULL if the ring is full
+static inline adc_scan* adc_ring_next(adc_ring* ring)
+{
+	if (ring->head - ring_load_acquire(&ring->tail) == ADC_RING_SCANS)
+		return NULL;
+	return &ring->scans[ring->head & (ADC_RING_SCANS - 1)];
+}
+
+// Publishes the scan filled through adc_ring_next
+static inline void adc_ring_produce(adc_ring* ring)
+{
+	ring_store_release(&ring->head, ring->head + 1);
+}
+
+// Returns where the consumer can read next, and in *n how many scans are
+// there before the ring is empty or the array wraps.
+static inline adc_scan* adc_ring_read_region(adc_ring* ring, unsigned int* n)
+{
+	unsigned int index = ring->tail & (ADC_RING_SCANS - 1);
+	unsigned int count = adc_ring_count(ring);
+
+	*n = ADC_RING_SCANS - index;
+	if (*n > count)
+		*n = count;
+	return &ring->scans[index];
+}
+
+// Hands n scans read through adc_ring_read_region back to the producer
+static inline void adc_ring_consume(adc_ring* ring, unsigned int n)
+{
+	ring_store_release(&ring->tail, ring->tail + n);
+}
+
+#endif
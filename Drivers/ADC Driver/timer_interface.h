@@ -0,0 +1,6 @@
+//Defines the offsets for the timer interface
+
+#define	TMR_STATUS    0x00
+#define TMR_CONTROL   0x01
+#define TMR_SVAL_LOW  0x02
+#define TMR_SVAL_HIGH 0x03
\ No newline at end of file
@@ -3,11 +3,22 @@
 #include <linux/fs.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
+#include <linux/interrupt.h>
+#include <linux/completion.h>
 #include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mutex.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <asm/io.h>
 #include <asm/uaccess.h>
 #include "aux_functions.h"
 #include "address_map_arm.h"
+#include "accel_stream.h"
 
 #define DEVICE_NAME "accel"
 #define MAX_SIZE 21+1
@@ -15,6 +26,16 @@
 #define FORMAT_CMD_PREAMBLE_SIZE 6
 #define RATE_CMD_PREAMBLE_SIZE 4
 #define PARAMS_FORMAT_EXPECTED 2
+#define FIFO_CMD_PREAMBLE_SIZE 5
+#define STREAM_RECORDS 4096 // a power of two, 1.28 s at 3200 Hz
+#define BURST_ENTRIES 8 // 7 commands and 6 bytes per entry, within I2C0_FIFO_DEPTH
+#define MIN_POLL_US 500
+#define MAX_POLL_US 100000 // so "fifo off" never waits long for the thread
+#define ENTRY_READ_NS 215000ULL // one entry's burst: about 86 SCL cycles of 2.5 us
+#define CALIBRATE_POLL_US 2000 // a fifth of a sample at the 100 Hz calibration rate
+#define I2C0_TIMEOUT_MS 100 // the longest burst takes about 1.5 ms at 400 kb/s
+// Sample period for a BW_RATE code: 3200 Hz at XL345_RATE_3200, halving per step
+#define XL345_PERIOD_NS(rate) (312500ULL << (XL345_RATE_3200 - (rate)))
 
 // Declare global variables needed to use the accelerometer
 volatile int *I2C0_ptr; // virtual address for I2C communication
@@ -28,6 +49,15 @@ static int device_open(struct inode *, struct file *);
 static int device_release(struct inode *, struct file *);
 static ssize_t device_read(struct file *, char *, size_t , loff_t *);
 static ssize_t device_write(struct file *, const char *, size_t , loff_t *);
+static unsigned int device_poll(struct file *, poll_table *);
+static ssize_t stream_read(struct file *, char *, size_t);
+static int stream_thread(void *);
+static void drain_fifo(void);
+static int start_stream(int);
+static void stop_stream(void);
+static unsigned int stream_poll_us(int, int);
+static int watermark_fits(int, int);
+irq_handler_t i2c0_irq_handler(int, void *, struct pt_regs *);
 
 int16_t mg_per_lsb = 31;
 
@@ -38,10 +68,36 @@ static struct cdev *cdev = NULL;
 static struct class *class = NULL;
 static char msg[MAX_SIZE];
 
+// Stream mode: a kernel thread drains the ADXL345's FIFO into
+// stream_fifo each time it holds watermark entries, and read() hands out
+// accel_records instead of text. i2c_mutex keeps the thread and the
+// commands from interleaving transfers on the bus. stream_mutex
+// serialises the commands, so only one of them starts or stops the
+// thread at a time; the thread never takes it.
+static DEFINE_MUTEX(stream_mutex);
+static DEFINE_MUTEX(i2c_mutex);
+static DEFINE_MUTEX(read_mutex);
+static DECLARE_KFIFO(stream_fifo, accel_record, STREAM_RECORDS);
+static DECLARE_WAIT_QUEUE_HEAD(stream_wait);
+static struct task_struct *stream_task = NULL;
+static int streaming = 0;
+static int watermark = 0;
+static int stream_lost = 0; // flag the next stored record
+static unsigned int stream_records = 0;
+static unsigned int stream_dropped = 0; // stream_fifo was full
+static unsigned int device_overruns = 0; // the ADXL345's FIFO overflowed
+
+// Transfers sleep on i2c_done, which the I2C0 interrupt completes. Without
+// the interrupt (i2c_irq is 0) they poll as before.
+static DECLARE_COMPLETION(i2c_done);
+static int i2c_irq = 0;
+static volatile unsigned int i2c_abort = 0; // TX_ABRT_SOURCE of the last abort
+
 static struct file_operations fops = {
 	.owner = THIS_MODULE,
 	.read = device_read,
 	.write = device_write,
+	.poll = device_poll,
 	.open = device_open,
 	.release = device_release
 };
@@ -78,12 +134,24 @@ static int __init start_accel(void)
 	if ((I2C0_ptr == 0) || (SYSMGR_ptr == 0))
 			printk (KERN_ERR "Error: ioremap_nocache returned NULL\n");
 		
+	INIT_KFIFO(stream_fifo);
 	Pinmux_Config();
 	I2C0_Init();
+
+	// Register the interrupt handler for I2C0 transfers. Another driver
+	// may own it; then transfers poll.
+	if (request_irq (I2C0_IRQ, (irq_handler_t) i2c0_irq_handler, 0,
+		"i2c0_irq_handler", (void *) (i2c0_irq_handler)) == 0)
+		i2c_irq = 1;
+	else
+		printk (KERN_WARNING "accel: I2C0 interrupt unavailable, polling transfers\n");
+
 	if (check_I2C())
 		ADXL345_Init(resolution, range, rate);
 	else {
 		printk (KERN_ERR "Error: I2C communication failed\n");
+		if (i2c_irq)
+			free_irq (I2C0_IRQ, (void*) i2c0_irq_handler);
 		return -1;
 	}
 	return 0;
@@ -91,6 +159,12 @@ static int __init start_accel(void)
 
 static void __exit stop_accel(void)
 {
+	mutex_lock(&stream_mutex);
+	stop_stream();
+	mutex_unlock(&stream_mutex);
+	if (i2c_irq)
+		free_irq (I2C0_IRQ, (void*) i2c0_irq_handler);
+
 	/* unmap the physical-to-virtual mappings */
     iounmap (I2C0_ptr);
 	iounmap (SYSMGR_ptr);
@@ -114,7 +188,13 @@ static ssize_t device_read(struct file *filp, char *buffer,
                            size_t length, loff_t *offset)
 {
 	size_t bytes;
+
+	if (streaming)
+		return stream_read(filp, buffer, length);
+
+	mutex_lock(&i2c_mutex);
 	format_read_data();
+	mutex_unlock(&i2c_mutex);
 	bytes = strlen (msg) - (*offset);	// how many bytes not yet sent?
 	bytes = bytes > length ? length : bytes;	// too much to send all at once?
 	
@@ -126,6 +206,40 @@ static ssize_t device_read(struct file *filp, char *buffer,
 	return bytes;
 }
 
+// Whole records only. Blocks until the thread stores some, unless the
+// file is non-blocking; returns 0 once streaming stops.
+static ssize_t stream_read(struct file *filp, char *buffer, size_t length)
+{
+	unsigned int copied = 0;
+	int err = 0;
+
+	if (length < sizeof(accel_record))
+		return -EINVAL;
+
+	if (kfifo_is_empty(&stream_fifo))
+	{
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_event_interruptible(stream_wait, !kfifo_is_empty(&stream_fifo) || !streaming))
+			return -ERESTARTSYS;
+	}
+
+	if (mutex_lock_interruptible(&read_mutex))
+		return -ERESTARTSYS;
+	err = kfifo_to_user(&stream_fifo, buffer, length - length % sizeof(accel_record), &copied);
+	mutex_unlock(&read_mutex);
+
+	return err ? err : copied;
+}
+
+static unsigned int device_poll(struct file *filp, poll_table *wait)
+{
+	poll_wait(filp, &stream_wait, wait);
+	if (!streaming)
+		return POLLIN | POLLRDNORM; // text reads never block
+	return kfifo_is_empty(&stream_fifo) ? 0 : POLLIN | POLLRDNORM;
+}
+
 
 static ssize_t device_write(struct file *filp, const char
                             *buffer, size_t length, loff_t *offset)
@@ -140,7 +254,20 @@ static ssize_t device_write(struct file *filp, const char
 	msg[bytes] = '\0';
 	if (msg[bytes-1] == '\n')
 		msg[bytes-1] = '\0';
-	
+
+	// The stream thread takes i2c_mutex, so it is started and stopped
+	// without holding it. Reset and calibration need the FIFO to themselves.
+	mutex_lock(&stream_mutex);
+	if (!strncmp(msg, "fifo ", FIFO_CMD_PREAMBLE_SIZE))
+	{
+		interpret_fifo_cmd(msg);
+		mutex_unlock(&stream_mutex);
+		return bytes;
+	}
+	if (!strcmp(msg, "init") || !strcmp(msg, "calibrate"))
+		stop_stream();
+
+	mutex_lock(&i2c_mutex);
 	if (!strcmp(msg, "device"))
 		printk("DevId: %02x\n", getDeviceId());
 	else if (!strcmp(msg, "init"))
@@ -172,10 +299,196 @@ static ssize_t device_write(struct file *filp, const char
 	{
 		interpret_rate_cmd(msg);
 	}
+	mutex_unlock(&i2c_mutex);
+
+	if (streaming && !watermark_fits(watermark, rate))
+	{
+		printk("Watermark %d is too high for the new rate\n", watermark);
+		stop_stream();
+	}
+	mutex_unlock(&stream_mutex);
 
 	return bytes;
 }
 
+// "fifo <watermark>" streams, draining the ADXL345 FIFO each time it
+// holds watermark entries (1 to 31). "fifo off" goes back to single reads.
+// Called with stream_mutex held.
+void interpret_fifo_cmd(char* msg)
+{
+	int param = 0;
+
+	if (!strcmp(msg + FIFO_CMD_PREAMBLE_SIZE, "off"))
+	{
+		stop_stream();
+		return;
+	}
+
+	if (kstrtoint(msg + FIFO_CMD_PREAMBLE_SIZE, 10, &param) != 0 ||
+	    param < 1 || param > XL345_FIFO_SAMPLES_MASK)
+	{
+		printk("ERROR: fifo command received invalid watermark. "
+				"Keeping previous setting.\n");
+		return;
+	}
+	if (!watermark_fits(param, rate))
+	{
+		printk("ERROR: watermark %d would let the FIFO overrun at this rate. "
+				"Keeping previous setting.\n", param);
+		return;
+	}
+
+	stop_stream();
+	if (start_stream(param) == 0)
+		printk("Streaming from the FIFO, watermark %d\n", param);
+}
+
+static int start_stream(int in_watermark)
+{
+	struct task_struct *task;
+
+	// Going through bypass empties the FIFO
+	mutex_lock(&i2c_mutex);
+	ADXL345_REG_WRITE(ADXL345_REG_FIFO_CTL, XL345_FIFO_BYPASS);
+	ADXL345_REG_WRITE(ADXL345_REG_FIFO_CTL, XL345_FIFO_STREAM | in_watermark);
+	mutex_unlock(&i2c_mutex);
+
+	kfifo_reset(&stream_fifo);
+	watermark = in_watermark;
+	stream_lost = 0;
+	stream_records = 0;
+	stream_dropped = 0;
+	device_overruns = 0;
+	streaming = 1;
+
+	task = kthread_run(stream_thread, NULL, "accel_stream");
+	if (IS_ERR(task))
+	{
+		printk(KERN_ERR "accel: could not start the stream thread\n");
+		streaming = 0;
+		mutex_lock(&i2c_mutex);
+		ADXL345_REG_WRITE(ADXL345_REG_FIFO_CTL, XL345_FIFO_BYPASS);
+		mutex_unlock(&i2c_mutex);
+		return PTR_ERR(task);
+	}
+	stream_task = task;
+	return 0;
+}
+
+static void stop_stream(void)
+{
+	if (!streaming)
+		return;
+
+	kthread_stop(stream_task);
+	stream_task = NULL;
+
+	mutex_lock(&i2c_mutex);
+	ADXL345_REG_WRITE(ADXL345_REG_FIFO_CTL, XL345_FIFO_BYPASS);
+	mutex_unlock(&i2c_mutex);
+
+	streaming = 0;
+	wake_up_interruptible(&stream_wait);
+	printk("Stream stopped: %u records, %u dropped, %u FIFO overruns\n",
+		stream_records, stream_dropped, device_overruns);
+}
+
+// A third of the time the FIFO takes to reach the watermark, or to fill
+// from there if that is shorter
+static unsigned int stream_poll_us(int in_watermark, int in_rate)
+{
+	int margin = min(in_watermark, XL345_FIFO_SIZE - in_watermark);
+	unsigned int wait_us = div_u64(margin * XL345_PERIOD_NS(in_rate), 3000);
+
+	return clamp_t(unsigned int, wait_us, MIN_POLL_US, MAX_POLL_US);
+}
+
+// The entries above the watermark must outlast the longest sleep
+// (usleep_range may run to 1.25 times it) plus reading the watermark's
+// worth of entries, or the FIFO overruns before the thread empties it.
+// MIN_POLL_US limits the watermark at high rates: 13 at 3200 Hz.
+static int watermark_fits(int in_watermark, int in_rate)
+{
+	unsigned long long headroom_ns = (XL345_FIFO_SIZE - in_watermark) * XL345_PERIOD_NS(in_rate);
+
+	return headroom_ns >= 2000ULL * stream_poll_us(in_watermark, in_rate) +
+		in_watermark * ENTRY_READ_NS;
+}
+
+static int stream_thread(void *data)
+{
+	unsigned int wait_us = 0;
+
+	while (!kthread_should_stop())
+	{
+		wait_us = stream_poll_us(watermark, rate);
+		usleep_range(wait_us, wait_us + wait_us / 4);
+
+		mutex_lock(&i2c_mutex);
+		drain_fifo();
+		mutex_unlock(&i2c_mutex);
+	}
+	return 0;
+}
+
+// Once the FIFO holds watermark entries, reads all of them, BURST_ENTRIES
+// per burst. The newest entry is stamped now and each older one a sample
+// period earlier.
+static void drain_fifo(void)
+{
+	uint8_t data[BURST_ENTRIES * XL345_ENTRY_BYTES];
+	uint8_t fifo_status = 0;
+	uint8_t int_source = 0;
+	accel_record record;
+	unsigned long long period_ns = XL345_PERIOD_NS(rate);
+	u64 now = 0;
+	int entries = 0;
+	int n = 0, k = 0, i = 0;
+
+	ADXL345_REG_READ(ADXL345_REG_FIFO_STATUS, &fifo_status);
+	entries = fifo_status & XL345_FIFO_ENTRIES_MASK;
+	if (entries < watermark)
+		return;
+	now = ktime_get_ns();
+
+	// Overrun clears once entries are read, so look first
+	ADXL345_REG_READ(ADXL345_REG_INT_SOURCE, &int_source);
+	if (int_source & XL345_OVERRUN)
+	{
+		device_overruns++;
+		stream_lost = 1;
+	}
+
+	for (k = 0; k < entries; k += n)
+	{
+		n = entries - k < BURST_ENTRIES ? entries - k : BURST_ENTRIES;
+		ADXL345_FIFO_BURST_READ(data, n);
+
+		for (i = 0; i < n; i++)
+		{
+			record.timestamp_ns = now - (entries - 1 - (k + i)) * period_ns;
+			record.x = (data[XL345_ENTRY_BYTES*i + 1] << 8) | data[XL345_ENTRY_BYTES*i];
+			record.y = (data[XL345_ENTRY_BYTES*i + 3] << 8) | data[XL345_ENTRY_BYTES*i + 2];
+			record.z = (data[XL345_ENTRY_BYTES*i + 5] << 8) | data[XL345_ENTRY_BYTES*i + 4];
+			record.mg_per_lsb = mg_per_lsb;
+			record.flags = stream_lost ? ACCEL_RECORD_LOST : 0;
+
+			if (kfifo_put(&stream_fifo, record))
+			{
+				stream_lost = 0;
+				stream_records++;
+			}
+			else
+			{
+				stream_lost = 1;
+				stream_dropped++;
+			}
+		}
+	}
+
+	wake_up_interruptible(&stream_wait);
+}
+
 void interpret_format_cmd(char* msg)
 {
 	const int param_resolution = 0;
@@ -319,6 +632,10 @@ void I2C0_Init(void){
     
     // Wait until I2C0 is disabled
     while(((*(I2C0_ptr + I2C0_ENABLE_STATUS))&0x1) == 1){cond_resched();}
+
+    // Interrupts are unmasked only while a transfer waits on them
+    *(I2C0_ptr + I2C0_INTR_MASK) = 0;
+    (void) *(I2C0_ptr + I2C0_CLR_INTR);
     
     // Configure the config reg with the desired setting (act as 
     // a master, use 7bit addressing, fast mode (400kb/s)).
@@ -339,8 +656,93 @@ void I2C0_Init(void){
     // Wait until controller is enabled
     while(((*(I2C0_ptr + I2C0_ENABLE_STATUS))&0x1) == 0){cond_resched();}
 }
+
+// RX_FULL and TX_EMPTY stay raised until the FIFOs move, so the handler
+// masks everything and leaves the rest to the waiting transfer.
+irq_handler_t i2c0_irq_handler(int irq, void *dev_id, struct pt_regs *regs)
+{
+	unsigned int status = *(I2C0_ptr + I2C0_INTR_STAT);
+
+	if (status == 0)
+		return (irq_handler_t) IRQ_NONE;
+
+	if (status & I2C0_INTR_TX_ABRT)
+	{
+		i2c_abort = *(I2C0_ptr + I2C0_TX_ABRT_SOURCE) | 0x80000000;
+		(void) *(I2C0_ptr + I2C0_CLR_TX_ABRT);
+	}
+	*(I2C0_ptr + I2C0_INTR_MASK) = 0;
+	complete(&i2c_done);
+
+	return (irq_handler_t) IRQ_HANDLED;
+}
+
+// Sleep until the RX FIFO holds level bytes (I2C0_INTR_RX_FULL) or the TX
+// FIFO is down to level commands (I2C0_INTR_TX_EMPTY). Polling, it only
+// yields, and the caller checks the FIFO again.
+int I2C0_Wait(unsigned int intr, int level){
+	int err = 0;
+
+	if (!i2c_irq){
+	    cond_resched();
+	    return 0;
+	}
+
+	if (intr == I2C0_INTR_RX_FULL)
+	    *(I2C0_ptr + I2C0_RX_TL) = level - 1; // raised above RX_TL
+	else
+	    *(I2C0_ptr + I2C0_TX_TL) = level;
+
+	// A level already reached interrupts as soon as it is unmasked
+	reinit_completion(&i2c_done);
+	*(I2C0_ptr + I2C0_INTR_MASK) = intr | I2C0_INTR_TX_ABRT;
+	if (!wait_for_completion_timeout(&i2c_done, msecs_to_jiffies(I2C0_TIMEOUT_MS)))
+	    err = -ETIMEDOUT;
+	*(I2C0_ptr + I2C0_INTR_MASK) = 0;
+
+	if (i2c_abort){
+	    printk(KERN_ERR "accel: I2C0 transfer aborted, source 0x%x\n", i2c_abort & 0x7FFFFFFF);
+	    i2c_abort = 0;
+	    err = -EIO;
+	}
+	return err;
+}
+
+// Collect len bytes that queued read commands asked for. After an abort
+// whatever did arrive is discarded so the next transfer starts clean. A
+// timeout may leave read commands queued whose bytes would arrive later,
+// so the controller is disabled, which flushes both FIFOs, and set up again.
+int I2C0_Read_Bytes(uint8_t values[], int len){
+	int nth_byte=0;
+	int avail=0;
+	int err=0;
+
+	while (nth_byte < len){
+	    avail = *(I2C0_ptr + I2C0_RXFLR);
+	    if (avail > 0){
+	        while (avail-- > 0 && nth_byte < len)
+	            values[nth_byte++] = *(I2C0_ptr + I2C0_DATA_CMD);
+	        continue;
+	    }
+
+	    if ((err = I2C0_Wait(I2C0_INTR_RX_FULL, min(len - nth_byte, I2C0_FIFO_DEPTH))) != 0){
+	        if (err == -ETIMEDOUT)
+	            I2C0_Init();
+	        else
+	            while (*(I2C0_ptr + I2C0_RXFLR) > 0)
+	                (void) *(I2C0_ptr + I2C0_DATA_CMD);
+	        return err;
+	    }
+	}
+	return 0;
+}
 // Write value to internal register at address
 void ADXL345_REG_WRITE(uint8_t address, uint8_t value){
+
+    // Make room for both commands
+    while (*(I2C0_ptr + I2C0_TXFLR) > I2C0_FIFO_DEPTH - 2)
+        if (I2C0_Wait(I2C0_INTR_TX_EMPTY, I2C0_FIFO_DEPTH / 2))
+            break;
     
     // Send reg address (+0x400 to send START signal)
     *(I2C0_ptr + I2C0_DATA_CMD) = address + 0x400;
@@ -358,15 +760,13 @@ void ADXL345_REG_READ(uint8_t address, uint8_t *value){
     // Send read signal
     *(I2C0_ptr + I2C0_DATA_CMD) = 0x100;
     
-    // Read the response (first wait until RX buffer contains data)  
-    while (*(I2C0_ptr + I2C0_RXFLR) == 0){cond_resched();}
-    *value = *(I2C0_ptr + I2C0_DATA_CMD);
+    // Read the response, sleeping until it arrives
+    I2C0_Read_Bytes(value, 1);
 }
 
 // Read multiple consecutive internal registers
 void ADXL345_REG_MULTI_READ(uint8_t address, uint8_t values[], uint8_t len){
 	int i=0;
-	int nth_byte=0;
 
     // Send reg address (+0x400 to send START signal)
     *(I2C0_ptr + I2C0_DATA_CMD) = address + 0x400;
@@ -376,15 +776,25 @@ void ADXL345_REG_MULTI_READ(uint8_t address, uint8_t values[], uint8_t len){
         *(I2C0_ptr + I2C0_DATA_CMD) = 0x100;
 	
     // Read the bytes
-	i=0;
-    while (len){
-        if ((*(I2C0_ptr + I2C0_RXFLR)) > 0){
-            values[nth_byte] = *(I2C0_ptr + I2C0_DATA_CMD);
-            nth_byte++;
-            len--;
-        }
-	cond_resched();
-    }
+    I2C0_Read_Bytes(values, len);
+}
+
+// Read entries FIFO entries back to back: every entry's six reads are
+// queued before any byte is collected, so the controller runs them as one
+// burst. The ADXL345 pops an entry after each read of DATAZ1; the restart
+// and address bytes before the next read give it the 5 us it needs.
+void ADXL345_FIFO_BURST_READ(uint8_t values[], int entries){
+	int i=0;
+	int e=0;
+
+	for (e=0;e<entries;e++){
+	    // Send reg address (+0x400 to send RESTART signal)
+	    *(I2C0_ptr + I2C0_DATA_CMD) = ADXL345_REG_DATAX0 + 0x400;
+	    for (i=0;i<XL345_ENTRY_BYTES;i++)
+	        *(I2C0_ptr + I2C0_DATA_CMD) = 0x100;
+	}
+
+	I2C0_Read_Bytes(values, entries * XL345_ENTRY_BYTES);
 }
 
 // Initialize the ADXL345 chip
@@ -464,6 +874,8 @@ void ADXL345_Calibrate(void){
             average_z += XYZ[2];
             i++;
         }
+        else
+            usleep_range(CALIBRATE_POLL_US, 2 * CALIBRATE_POLL_US);
     }
     average_x = ROUNDED_DIVISION(average_x, 32);
     average_y = ROUNDED_DIVISION(average_y, 32);
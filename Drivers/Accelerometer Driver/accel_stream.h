@@ -0,0 +1,22 @@
+#ifndef _ACCEL_STREAM_
+#define _ACCEL_STREAM_
+
+/* Binary records read() returns while the accelerometer streams from its
+ * FIFO (after the "fifo <watermark>" command). The driver drains the
+ * ADXL345's FIFO into a kernel FIFO of these, oldest first.
+ *
+ * Shared with user space: keep the layout fixed.
+ */
+
+#define ACCEL_RECORD_LOST 0x01 // samples were lost just before this one
+
+// One XYZ sample, 16 bytes
+typedef struct accel_record
+{
+	unsigned long long timestamp_ns; // CLOCK_MONOTONIC, counted back from the drain at the sample period
+	short x, y, z; // raw counts
+	unsigned char mg_per_lsb;
+	unsigned char flags;
+} accel_record;
+
+#endif
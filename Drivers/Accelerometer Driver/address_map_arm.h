@@ -59,11 +59,22 @@
 #define XL345_ACT_INACT_SERIAL     0x20
 #define XL345_ACT_INACT_CONCURRENT 0x00
 
+/* Bit values in FIFO_CTL and FIFO_STATUS                               */
+#define XL345_FIFO_BYPASS          0x00
+#define XL345_FIFO_MODE            0x40
+#define XL345_FIFO_STREAM          0x80
+#define XL345_FIFO_TRIGGER         0xC0
+#define XL345_FIFO_SAMPLES_MASK    0x1F  // watermark in FIFO_CTL
+#define XL345_FIFO_ENTRIES_MASK    0x3F  // entries held, in FIFO_STATUS
+#define XL345_FIFO_SIZE            32
+#define XL345_ENTRY_BYTES          6     // DATAX0 to DATAZ1, read as one to pop an entry
+
 // ADXL345 Register List
 #define ADXL345_REG_DEVID       	0x00
 #define ADXL345_REG_POWER_CTL   	0x2D
 #define ADXL345_REG_DATA_FORMAT 	0x31
 #define ADXL345_REG_FIFO_CTL    	0x38
+#define ADXL345_REG_FIFO_STATUS 	0x39  // read only
 #define ADXL345_REG_BW_RATE     	0x2C
 #define ADXL345_REG_INT_ENABLE  	0x2E  // default value: 0x00
 #define ADXL345_REG_INT_MAP     	0x2F  // default value: 0x00
@@ -133,10 +144,26 @@
 #define I2C0_DATA_CMD         0x00000004		// word offset
 #define I2C0_FS_SCL_HCNT      0x00000007		// word offset
 #define I2C0_FS_SCL_LCNT      0x00000008		// word offset
+#define I2C0_INTR_STAT        0x0000000B		// word offset
+#define I2C0_INTR_MASK        0x0000000C		// word offset
+#define I2C0_RAW_INTR_STAT    0x0000000D		// word offset
+#define I2C0_RX_TL            0x0000000E		// word offset
+#define I2C0_TX_TL            0x0000000F		// word offset
+#define I2C0_CLR_INTR         0x00000010		// word offset
+#define I2C0_CLR_TX_ABRT      0x00000015		// word offset
 #define I2C0_ENABLE           0x0000001B		// word offset
+#define I2C0_TXFLR            0x0000001D		// word offset
 #define I2C0_RXFLR            0x0000001E		// word offset
+#define I2C0_TX_ABRT_SOURCE   0x00000020		// word offset
 #define I2C0_ENABLE_STATUS    0x00000027		// word offset
+#define I2C0_FIFO_DEPTH       64				// entries in each of the TX and RX FIFOs
 #define I2C0_SPAN					0x00000100		// span
+#define I2C0_IRQ					190				// HPS I2C0 (GIC SPI 158)
+
+/* Bit values in I2C0 INTR_STAT, INTR_MASK and RAW_INTR_STAT             */
+#define I2C0_INTR_RX_FULL     0x04	// RX FIFO holds more than RX_TL bytes
+#define I2C0_INTR_TX_EMPTY    0x10	// TX FIFO holds TX_TL commands or fewer
+#define I2C0_INTR_TX_ABRT     0x40	// transfer aborted, e.g. no ACK; TX FIFO flushed
 
 #define SYSMGR_BASE				0xFFD08000		// base
 #define SYSMGR_GENERALIO7     0x00000127		// word offset
@@ -170,9 +197,12 @@ void ADXL345_IdRead(uint8_t *pId);
 void ADXL345_REG_READ(uint8_t address, uint8_t *value);
 void ADXL345_REG_WRITE(uint8_t address, uint8_t value);
 void ADXL345_REG_MULTI_READ(uint8_t address, uint8_t values[], uint8_t len);
+void ADXL345_FIFO_BURST_READ(uint8_t values[], int entries);
 
 // I2C0 Functions
 void I2C0_Init(void);
+int I2C0_Wait(unsigned int intr, int level);
+int I2C0_Read_Bytes(uint8_t values[], int len);
 
 // Pinmux Functions
 void Pinmux_Config(void);
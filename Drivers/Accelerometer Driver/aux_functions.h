@@ -6,6 +6,7 @@ int check_I2C(void);
 int getDeviceId(void);
 void interpret_format_cmd(char*);
 void interpret_rate_cmd(char* msg);
+void interpret_fifo_cmd(char* msg);
 void calculate_mg_per_lsb(void);
 
 #endif /*AUX_FUNCTIONS_H*/
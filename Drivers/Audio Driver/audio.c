@@ -0,0 +1,261 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/interrupt.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+#include "address_map_arm.h"
+#include "interrupt_ID.h"
+#include "audio_interface.h"
+#include "audio_ring.h"
+
+#define SUCCESS 0
+#define AUDIO_DEVICE_NAME "audio"
+#define MAX_SIZE 64
+#define DRAIN_TIMEOUT HZ // longest release() waits for queued frames to play
+
+/* Kernel character device driver for the audio core output FIFOs.
+ * Clients write() interleaved left/right 32-bit frames (audio_frame), or
+ * mmap() the audio_ring and fill it directly. The audio core interrupts
+ * when its output FIFOs are 75% empty and the handler refills them from
+ * the ring, so nobody polls FIFOSPACE. write() queues at most the ring's
+ * fill_limit frames, AUDIO_FILL_FRAMES from open(); an mmap() client may
+ * change it. Reading gives "<queued frames> <free frames> <silent frames>",
+ * free counting up to the limit.
+ */
+
+static int audio_device_open (struct inode *, struct file *);
+static int audio_device_release (struct inode *, struct file *);
+static ssize_t audio_device_read (struct file *, char *, size_t, loff_t *);
+static ssize_t audio_device_write(struct file *filp, const char *buffer, size_t length, loff_t *offset);
+static unsigned int audio_device_poll(struct file *, poll_table *);
+static int audio_device_mmap(struct file *, struct vm_area_struct *);
+
+static dev_t audio_dev_no = 0;
+static struct cdev *audio_cdev = NULL;
+static struct class *audio_class = NULL;
+static char audio_msg[MAX_SIZE];
+
+static struct file_operations audio_fops = {
+	.owner = THIS_MODULE,
+	.read = audio_device_read,
+	.write = audio_device_write,
+	.poll = audio_device_poll,
+	.mmap = audio_device_mmap,
+	.open = audio_device_open,
+	.release = audio_device_release
+};
+
+irq_handler_t audio_irq_handler(int irq, void *dev_id, struct pt_regs *regs);
+void put_frame(const audio_frame* frame);
+unsigned int fifo_space(void);
+
+void* LW_virtual;
+volatile unsigned int* audio_ptr;
+static audio_ring* ring = NULL;
+
+// Writers sleep here until the interrupt has freed room in the ring
+static DECLARE_WAIT_QUEUE_HEAD(audio_wait);
+// One producer at a time: the ring is single producer
+static DEFINE_MUTEX(audio_open_mutex);
+static bool audio_in_use = false;
+
+static int __init start_driver(void)
+{
+	int err = 0;
+
+	ring = vmalloc_user(PAGE_ALIGN(sizeof(audio_ring)));
+	if (ring == NULL)
+		return -ENOMEM;
+
+	LW_virtual = ioremap_nocache(LW_BRIDGE_BASE, LW_BRIDGE_SPAN);
+	audio_ptr = LW_virtual + AUDIO_BASE;
+
+	// Interrupts stay off until a client opens the device
+	*(audio_ptr + AUDIO_CONTROL) = AUDIO_CW;
+	*(audio_ptr + AUDIO_CONTROL) = 0;
+
+	/* Get a device number. Get one minor number (0) */
+	if ((err = alloc_chrdev_region (&audio_dev_no, 0, 1, AUDIO_DEVICE_NAME)) < 0) {
+		printk (KERN_ERR "audio: alloc_chrdev_region() failed with return value %d\n", err);
+		return err;
+	}
+
+	// Allocate and initialize the character device
+	audio_cdev = cdev_alloc (); 
+	audio_cdev->ops = &audio_fops; 
+	audio_cdev->owner = THIS_MODULE; 
+   
+	// Add the character device to the kernel
+	if ((err = cdev_add (audio_cdev, audio_dev_no, 1)) < 0) {
+		printk (KERN_ERR "audio: cdev_add() failed with return value %d\n", err);
+		return err;
+	}
+	
+	audio_class = class_create (THIS_MODULE, AUDIO_DEVICE_NAME);
+	device_create (audio_class, NULL, audio_dev_no, NULL, AUDIO_DEVICE_NAME );
+
+	// Register the interrupt handler for the audio core
+	err = request_irq (AUDIO_IRQ, (irq_handler_t) audio_irq_handler, 0, 
+		"audio_irq_handler", (void *) (audio_irq_handler));
+
+	return err;
+}
+
+static void __exit stop_driver(void)
+{
+	*(audio_ptr + AUDIO_CONTROL) = 0;
+	free_irq (AUDIO_IRQ, (void*) audio_irq_handler);
+	iounmap (LW_virtual);
+	vfree (ring);
+	device_destroy (audio_class, audio_dev_no);
+	cdev_del (audio_cdev);
+	class_destroy (audio_class);
+	unregister_chrdev_region (audio_dev_no, 1);
+}
+
+// Refills the output FIFOs from the ring, with silence if it ran dry,
+// then wakes up writers waiting for room.
+irq_handler_t audio_irq_handler(int irq, void *dev_id, struct pt_regs *regs)
+{
+	audio_ring_feed(ring, fifo_space(), put_frame);
+	wake_up_interruptible(&audio_wait);
+
+	return (irq_handler_t) IRQ_HANDLED;
+}
+
+void put_frame(const audio_frame* frame)
+{
+	*(audio_ptr + AUDIO_LDATA) = frame->left;
+	*(audio_ptr + AUDIO_RDATA) = frame->right;
+}
+
+// Free words in the emptier of the two output FIFOs
+unsigned int fifo_space(void)
+{
+	unsigned int fifospace = *(audio_ptr + AUDIO_FIFOSPACE);
+	unsigned int left = AUDIO_WSLC(fifospace);
+	unsigned int right = AUDIO_WSRC(fifospace);
+
+	return left < right ? left : right;
+}
+
+/* Called when a process opens audio. Starts the refill interrupts. */
+static int audio_device_open(struct inode *inode, struct file *file)
+{
+	mutex_lock(&audio_open_mutex);
+	if (audio_in_use)
+	{
+		mutex_unlock(&audio_open_mutex);
+		return -EBUSY;
+	}
+	audio_in_use = true;
+	mutex_unlock(&audio_open_mutex);
+
+	ring->head = 0;
+	ring->tail = 0;
+	ring->underruns = 0;
+	ring->fill_limit = AUDIO_FILL_FRAMES;
+	*(audio_ptr + AUDIO_CONTROL) = AUDIO_WE;
+
+	return SUCCESS;
+}
+
+/* Called when a process closes audio. Lets queued frames play out
+ * (for at most DRAIN_TIMEOUT), then stops the interrupts. */
+static int audio_device_release(struct inode *inode, struct file *file)
+{
+	wait_event_interruptible_timeout(audio_wait, audio_ring_count(ring) == 0, DRAIN_TIMEOUT);
+	*(audio_ptr + AUDIO_CONTROL) = AUDIO_CW;
+	*(audio_ptr + AUDIO_CONTROL) = 0;
+
+	mutex_lock(&audio_open_mutex);
+	audio_in_use = false;
+	mutex_unlock(&audio_open_mutex);
+
+	return 0;
+}
+
+/* Called when a process reads from audio. Provides the ring status.
+ * Returns, and sets *offset to, the number of bytes read. */
+static ssize_t audio_device_read(struct file *filp, char *buffer, size_t length, loff_t *offset)
+{
+	size_t bytes;
+	unsigned int queued = audio_ring_count(ring);
+
+	sprintf(audio_msg, "%u %u %u\n", queued, audio_ring_room(ring), ring->underruns);
+	bytes = strlen (audio_msg) - (*offset);	// how many bytes not yet sent?
+	bytes = bytes > length ? length : bytes;	// too much to send all at once?
+	
+	if (bytes)
+		if (copy_to_user (buffer, &audio_msg[*offset], bytes) != 0)
+			printk (KERN_ERR "Error: copy_to_user unsuccessful");
+	*offset = bytes;	// keep track of number of bytes sent to the user
+	
+	return bytes;
+}
+
+/* Called when a process writes to audio. Queues whole frames up to the
+ * ring's fill_limit, sleeping while it is reached unless the file is
+ * non-blocking. Returns the number of bytes queued. */
+static ssize_t audio_device_write(struct file *filp, const char *buffer, size_t length, loff_t *offset)
+{
+	size_t frames = length / sizeof(audio_frame);
+	size_t written = 0;
+	audio_frame* region = NULL;
+	unsigned int n = 0;
+
+	while (written < frames)
+	{
+		if (audio_ring_room(ring) == 0)
+		{
+			if (written)
+				break;
+			if (filp->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+			if (wait_event_interruptible(audio_wait, audio_ring_room(ring) > 0))
+				return -ERESTARTSYS;
+		}
+
+		region = audio_ring_write_region(ring, &n);
+		if (n > frames - written)
+			n = frames - written;
+		if (copy_from_user (region, buffer + written * sizeof(audio_frame), n * sizeof(audio_frame)) != 0)
+			return written ? written * sizeof(audio_frame) : -EFAULT;
+		audio_ring_produce(ring, n);
+		written += n;
+	}
+
+	return written * sizeof(audio_frame);
+}
+
+static unsigned int audio_device_poll(struct file *filp, poll_table *wait)
+{
+	poll_wait(filp, &audio_wait, wait);
+
+	if (audio_ring_room(ring) > 0)
+		return POLLOUT | POLLWRNORM;
+	return 0;
+}
+
+// Maps the whole audio_ring: the client writes frames and advances head
+// itself, exactly like audio_ring_write_region/audio_ring_produce.
+static int audio_device_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	if (vma->vm_end - vma->vm_start > PAGE_ALIGN(sizeof(audio_ring)))
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring, vma->vm_pgoff);
+}
+
+MODULE_LICENSE("GPL");
+module_init (start_driver);
+module_exit (stop_driver);
@@ -0,0 +1,18 @@
+//Defines the offsets and bits for the audio core interface
+
+#define AUDIO_CONTROL    0x00
+#define AUDIO_FIFOSPACE  0x01
+#define AUDIO_LDATA      0x02
+#define AUDIO_RDATA      0x03
+
+// CONTROL register bits
+#define AUDIO_RE         0x001 // read interrupt enable
+#define AUDIO_WE         0x002 // write interrupt enable
+#define AUDIO_CR         0x004 // clear read FIFOs
+#define AUDIO_CW         0x008 // clear write FIFOs
+#define AUDIO_WI         0x200 // write interrupt pending: output FIFOs 75% empty
+
+// FIFOSPACE register fields
+#define AUDIO_WSLC(fifospace) (((fifospace) >> 24) & 0xFF) // free words in the left output FIFO
+#define AUDIO_WSRC(fifospace) (((fifospace) >> 16) & 0xFF) // free words in the right output FIFO
+#define AUDIO_FIFO_DEPTH 128
@@ -0,0 +1,115 @@
+#ifndef _AUDIO_RING_
+#define _AUDIO_RING_
+
+/* Single producer, single consumer ring of stereo frames. The producer
+ * is write() or a process that mmap()ed the ring; the consumer is the
+ * audio interrupt, which moves frames into the audio core FIFOs. Only
+ * the producer writes head and only the consumer writes tail, so neither
+ * side takes a lock. Both indexes run freely and wrap at 2^32.
+ *
+ * Header only, so it builds in the driver and in user space (see
+ * audio_sim.c and the "sim" target in the Makefile).
+ */
+
+#define AUDIO_RING_FRAMES 4096 // must be a power of two, about 0.5 s at 8 kHz
+#define AUDIO_FILL_FRAMES 384 // default fill_limit: three 128-frame blocks, 48 ms at 8 kHz
+
+#ifdef __KERNEL__
+#include <asm/barrier.h>
+#define ring_load_acquire(p) smp_load_acquire(p)
+#define ring_store_release(p, v) smp_store_release(p, v)
+#else
+#define ring_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ring_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+typedef struct audio_frame
+{
+	int left, right;
+} audio_frame;
+
+// Shared with user space through mmap(): keep the layout fixed.
+typedef struct audio_ring
+{
+	unsigned int head; // next frame the producer fills
+	unsigned int tail; // next frame the consumer plays
+	unsigned int underruns; // frames of silence played because the ring was empty
+	unsigned int fill_limit; // producers queue at most this many frames, 0 for the whole ring
+	audio_frame frames[AUDIO_RING_FRAMES];
+} audio_ring;
+
+// Frames waiting to be played. Head is re-read with acquire, so the
+// frames it covers are visible. A head further than AUDIO_RING_FRAMES
+// ahead (a confused mmap() client) counts as a full ring.
+static inline unsigned int audio_ring_count(audio_ring* ring)
+{
+	unsigned int count = ring_load_acquire(&ring->head) - ring->tail;
+
+	return count > AUDIO_RING_FRAMES ? AUDIO_RING_FRAMES : count;
+}
+
+// Frames the producer may still write
+static inline unsigned int audio_ring_space(audio_ring* ring)
+{
+	return AUDIO_RING_FRAMES - (ring->head - ring_load_acquire(&ring->tail));
+}
+
+// Frames the producer may still write without queueing more than
+// fill_limit. Keeping the ring shallow keeps latency low: every queued
+// frame delays the next one written by 1/rate.
+static inline unsigned int audio_ring_room(audio_ring* ring)
+{
+	unsigned int limit = ring->fill_limit;
+	unsigned int queued = AUDIO_RING_FRAMES - audio_ring_space(ring);
+
+	if (limit == 0 || limit > AUDIO_RING_FRAMES)
+		limit = AUDIO_RING_FRAMES;
+	return queued >= limit ? 0 : limit - queued;
+}
+
+// Returns where the producer can write next, and in *n how many frames
+// fit there before the fill limit is reached or the array wraps.
+static inline audio_frame* audio_ring_write_region(audio_ring* ring, unsigned int* n)
+{
+	unsigned int index = ring->head & (AUDIO_RING_FRAMES - 1);
+	unsigned int space = audio_ring_room(ring);
+
+	*n = AUDIO_RING_FRAMES - index;
+	if (*n > space)
+		*n = space;
+	return &ring->frames[index];
+}
+
+// Publishes n frames written through audio_ring_write_region
+static inline void audio_ring_produce(audio_ring* ring, unsigned int n)
+{
+	ring_store_release(&ring->head, ring->head + n);
+}
+
+// Consumer side: hands space frames to put, one at a time, padding with
+// silence when the ring runs dry so the FIFO never starves the codec.
+// Returns the number of silent frames.
+static inline unsigned int audio_ring_feed(audio_ring* ring, unsigned int space,
+                                           void (*put)(const audio_frame*))
+{
+	static const audio_frame silence = {0, 0};
+	unsigned int available = audio_ring_count(ring);
+	unsigned int tail = ring->tail;
+	unsigned int n = 0;
+
+	if (available > space)
+		available = space;
+
+	for (n = 0; n < available; n++)
+		put(&ring->frames[(tail + n) & (AUDIO_RING_FRAMES - 1)]);
+	// Hand the slots back only after they have been read
+	ring_store_release(&ring->tail, tail + available);
+
+	for (n = available; n < space; n++)
+		put(&silence);
+
+	ring->underruns += space - available;
+	return space - available;
+}
+
+#endif
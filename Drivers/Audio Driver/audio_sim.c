@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include "audio_interface.h"
+#include "audio_ring.h"
+
+/* Runs audio_ring.h in user space against a simulated audio core. The
+ * "interrupt" thread drains the FIFO at the sample rate and refills it
+ * through audio_ring_feed every time it is 75% empty, like the driver.
+ * The producer writes blocks of a counting sequence, the way a client
+ * would write() them, so the consumer can check nothing is lost,
+ * duplicated or reordered.
+ *
+ * Usage: ./audio_sim [-r rate] [-b block_frames] [-s seconds] [-j jitter_us] [-l fill_limit]
+ *   -j  sleep up to jitter_us at random between blocks, to provoke underruns
+ *   -l  frames the producer keeps queued (default AUDIO_FILL_FRAMES, 0 for the whole ring)
+ */
+
+#define IRQ_THRESHOLD (AUDIO_FIFO_DEPTH * 3 / 4) // free words that raise the write interrupt
+
+static audio_ring ring;
+static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER; // stands in for the driver's wait queue
+static volatile int done = 0;
+
+int rate = 8000;
+int block_frames = 128;
+int seconds = 2;
+int jitter_us = 0;
+int fill_limit = AUDIO_FILL_FRAMES;
+
+unsigned int expected = 1; // next value of the sequence the consumer should see
+unsigned long played = 0;
+unsigned long order_errors = 0;
+unsigned int max_queued = 0;
+
+void sleep_us(long us)
+{
+	struct timespec t = {us / 1000000, (us % 1000000) * 1000};
+
+	nanosleep(&t, NULL);
+}
+
+// Simulated FIFO sink: checks the sequence, ignoring inserted silence
+void put_frame(const audio_frame* frame)
+{
+	if (frame->left == 0)
+		return;
+	if ((unsigned int) frame->left != expected || frame->right != -frame->left)
+		order_errors++;
+	expected = frame->left + 1;
+	played++;
+}
+
+// Same loop as the driver's write(): wait for room only before the first
+// frame, copy, publish, and return short once the ring fills
+unsigned int write_frames(audio_frame* frames, unsigned int count)
+{
+	audio_frame* region = NULL;
+	unsigned int written = 0;
+	unsigned int n = 0;
+	unsigned int i = 0;
+
+	while (written < count)
+	{
+		if (audio_ring_room(&ring) == 0)
+		{
+			if (written)
+				break;
+			pthread_mutex_lock(&wait_mutex);
+			while (audio_ring_room(&ring) == 0 && !done)
+				pthread_cond_wait(&wait_cond, &wait_mutex);
+			pthread_mutex_unlock(&wait_mutex);
+			if (done)
+				return written;
+		}
+
+		region = audio_ring_write_region(&ring, &n);
+		if (n > count - written)
+			n = count - written;
+		for (i = 0; i < n; i++)
+			region[i] = frames[written + i];
+		audio_ring_produce(&ring, n);
+		written += n;
+	}
+
+	return written;
+}
+
+void* producer_thread(void* none)
+{
+	audio_frame* block = malloc(block_frames * sizeof(audio_frame));
+	unsigned int value = 1;
+	unsigned int written = 0;
+	int i = 0;
+
+	while (!done)
+	{
+		for (i = 0; i < block_frames; i++, value++)
+		{
+			block[i].left = value;
+			block[i].right = -(int) value;
+		}
+		// Like output_block() in the piano, keep writing the rest of a short write
+		for (written = 0; written < block_frames && !done; )
+			written += write_frames(block + written, block_frames - written);
+
+		if (jitter_us)
+			sleep_us(rand() % jitter_us);
+	}
+
+	free(block);
+	return NULL;
+}
+
+// Plays IRQ_THRESHOLD frames per interrupt, at the sample rate
+void* interrupt_thread(void* none)
+{
+	long period_us = 1000000L * IRQ_THRESHOLD / rate;
+	long irqs = (long) seconds * rate / IRQ_THRESHOLD;
+	unsigned int queued = 0;
+	long i = 0;
+
+	audio_ring_feed(&ring, AUDIO_FIFO_DEPTH, put_frame);
+	for (i = 0; i < irqs; i++)
+	{
+		sleep_us(period_us);
+
+		queued = audio_ring_count(&ring);
+		if (queued > max_queued)
+			max_queued = queued;
+
+		audio_ring_feed(&ring, IRQ_THRESHOLD, put_frame);
+		pthread_mutex_lock(&wait_mutex);
+		pthread_cond_broadcast(&wait_cond);
+		pthread_mutex_unlock(&wait_mutex);
+	}
+
+	pthread_mutex_lock(&wait_mutex);
+	done = 1;
+	pthread_cond_broadcast(&wait_cond);
+	pthread_mutex_unlock(&wait_mutex);
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	pthread_t tid_producer, tid_interrupt;
+	int option = 0;
+
+	while ((option = getopt(argc, argv, "r:b:s:j:l:")) != -1)
+	{
+		switch (option)
+		{
+			case 'r':
+				rate = atoi(optarg);
+			break;
+			case 'b':
+				block_frames = atoi(optarg);
+			break;
+			case 's':
+				seconds = atoi(optarg);
+			break;
+			case 'j':
+				jitter_us = atoi(optarg);
+			break;
+			case 'l':
+				fill_limit = atoi(optarg);
+			break;
+			default:
+				fprintf(stderr, "Usage: %s [-r rate] [-b block_frames] [-s seconds] [-j jitter_us] [-l fill_limit]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (rate <= 0 || block_frames <= 0 || seconds <= 0 || jitter_us < 0 || fill_limit < 0)
+	{
+		fprintf(stderr, "Invalid argument\n");
+		return 1;
+	}
+
+	ring.fill_limit = fill_limit; // as the driver's open() does
+	pthread_create(&tid_interrupt, NULL, &interrupt_thread, NULL);
+	pthread_create(&tid_producer, NULL, &producer_thread, NULL);
+	pthread_join(tid_interrupt, NULL);
+	pthread_join(tid_producer, NULL);
+
+	printf("played %lu frames, %u silent, %lu out of order, at most %u queued (%.1f ms), fill limit %u of %u\n",
+	       played, ring.underruns, order_errors, max_queued, max_queued * 1000.0 / rate,
+	       ring.fill_limit, AUDIO_RING_FRAMES);
+
+	return order_errors ? 1 : 0;
+}
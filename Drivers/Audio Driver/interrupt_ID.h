@@ -0,0 +1,21 @@
+/* FPGA interrupts (there are 64 in total; only a few are defined below) */
+#define	TIMER0_IRQ							72
+#define	KEY_IRQ		 						73
+#define	TIMER1_IRQ							74
+#define	FPGA_IRQ3	 						75
+#define	FPGA_IRQ4	 						76
+#define	FPGA_IRQ5	 						77
+#define	AUDIO_IRQ							78
+#define	PS2_IRQ		 						79
+#define	JTAG_IRQ		 						80
+#define	IrDA_IRQ		 						81
+#define	FPGA_IRQ10							82
+#define	JP1_IRQ								83
+#define	JP2_IRQ								84
+#define	FPGA_IRQ13							85
+#define	FPGA_IRQ14							86
+#define	FPGA_IRQ15							87
+#define	FPGA_IRQ16							88
+#define	PS2_DUAL_IRQ						89
+#define	FPGA_IRQ18							90
+#define	FPGA_IRQ19							91
@@ -0,0 +1,99 @@
+#ifndef _VIDEO_COMPAT_
+#define _VIDEO_COMPAT_
+
+/* Lets video_core.c build both as part of the kernel module and as a
+ * plain user space object (see the "sim" target in the Makefile).
+ */
+
+#ifdef __KERNEL__
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/mutex.h>
+#include <linux/io.h>
+
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#define video_malloc(size) kmalloc(size, GFP_KERNEL)
+#define video_free(ptr) kfree(ptr)
+#define video_time_us() ktime_to_us(ktime_get())
+#define video_div64(n, d) div_u64(n, d)
+// The pixel buffers are ioremap'd device memory
+#define video_memcpy_toio(dst, src, n) memcpy_toio((void __iomem *) (dst), src, n)
+#define video_memcpy_fromio(dst, src, n) memcpy_fromio(dst, (const void __iomem *) (src), n)
+#define video_memset_io(dst, c, n) memset_io((void __iomem *) (dst), c, n)
+
+#else
+
+#define _DEFAULT_SOURCE // strsep
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define video_malloc(size) malloc(size)
+#define video_free(ptr) free(ptr)
+#define video_div64(n, d) ((n) / (d))
+#define video_memcpy_toio(dst, src, n) memcpy(dst, src, n)
+#define video_memcpy_fromio(dst, src, n) memcpy(dst, src, n)
+#define video_memset_io(dst, c, n) memset(dst, c, n)
+#define ERESTARTSYS EINTR
+
+static inline long long video_time_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// Like the kernel's scnprintf, returns the number of characters
+// actually written, never more than size - 1.
+static inline int scnprintf(char* buf, size_t size, const char* fmt, ...)
+{
+	va_list args;
+	int length = 0;
+
+	if (size == 0)
+		return 0;
+
+	va_start(args, fmt);
+	length = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+
+	if (length < 0)
+		return 0;
+	return (size_t) length >= size ? size - 1 : length;
+}
+
+// Same contract as the kernel's kstrtoint: the whole string (bar one
+// trailing newline) must be a number, otherwise -EINVAL is returned.
+static inline int kstrtoint(const char* s, unsigned int base, int* res)
+{
+	char* end = NULL;
+	long value = 0;
+
+	if (*s == '\0' || *s == ' ' || *s == '\t')
+		return -EINVAL;
+
+	errno = 0;
+	value = strtol(s, &end, base);
+	if (errno || value > 0x7FFFFFFFL || value < -0x7FFFFFFFL - 1)
+		return -ERANGE;
+	if (*end == '\n')
+		end++;
+	if (end == s || *end != '\0')
+		return -EINVAL;
+
+	*res = (int) value;
+	return 0;
+}
+
+#endif
+
+#endif
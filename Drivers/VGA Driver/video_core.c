@@ -0,0 +1,1210 @@
+#include "video_compat.h"
+#include "video_core.h"
+
+/* Hardware independent part of the video driver: rasterizer, character
+ * buffer operations, stored surfaces and the command parser. Everything
+ * here draws through the video_backend installed with video_set_backend,
+ * so the same code runs in the kernel module and in user space (see
+ * video_soft.c).
+ */
+
+#define PIXEL_CMD_PREAMBLE_SIZE 6
+#define LINE_CMD_PREAMBLE_SIZE 5
+#define BOX_CMD_PREAMBLE_SIZE 4
+#define TEXT_CMD_PREAMBLE_SIZE 5
+#define WAVE_CMD_PREAMBLE_SIZE 5
+#define PEAKS_CMD_PREAMBLE_SIZE 6
+#define COLOR_CMD_PREAMBLE_SIZE 6
+#define CLIP_CMD_PREAMBLE_SIZE 5
+#define SURFACE_CMD_PREAMBLE_SIZE 8
+#define BLIT_CMD_PREAMBLE_SIZE 5
+#define FREE_CMD_PREAMBLE_SIZE 5
+#define TEXTBOX_CMD_PREAMBLE_SIZE 8
+#define CLEARTEXT_CMD_PREAMBLE_SIZE 10
+#define SCROLL_CMD_PREAMBLE_SIZE 7
+#define LOG_CMD_PREAMBLE_SIZE 4
+#define SCROLL_BOUNCE_SIZE 128 // characters moved per copy while scrolling
+
+// Cohen-Sutherland outcodes
+#define OUT_INSIDE 0
+#define OUT_LEFT   1
+#define OUT_RIGHT  2
+#define OUT_TOP    4
+#define OUT_BOTTOM 8
+
+static video_backend* backend = NULL;
+short int* draw_buffer; // buffer the current command draws into (see select_context)
+int clip_x0, clip_y0, clip_x1, clip_y1; // clip window of the current command
+int resolution_x, resolution_y; // VGA screen size
+int c_resolution_x, c_resolution_y;
+
+// Off-screen surfaces uploaded by clients, shared by every open file
+// and protected by the video lock.
+static surface surfaces[MAX_SURFACES];
+
+static video_stats stats;
+
+// Names used by video_format_stats, in command_type order
+static const char* command_names[CMD_TYPES] =
+{
+	"clear", "pixel", "line", "box", "sync", "erase", "text", "wave",
+	"peaks", "textbox", "cleartext", "scroll", "log", "blit", "free",
+	"color", "clip", "layer", "surface", "unknown"
+};
+
+void video_set_backend(video_backend* new_backend)
+{
+	backend = new_backend;
+	resolution_x = backend->resolution_x;
+	resolution_y = backend->resolution_y;
+	c_resolution_x = backend->c_resolution_x;
+	c_resolution_y = backend->c_resolution_y;
+	draw_buffer = backend->back_buffer;
+	clip_x0 = 0;
+	clip_y0 = 0;
+	clip_x1 = resolution_x - 1;
+	clip_y1 = resolution_y - 1;
+}
+
+void init_context(video_context* ctx)
+{
+	ctx->color = DEFAULT_COLOR;
+	ctx->layer = LAYER_BACK;
+	reset_clip(ctx);
+}
+
+void get_screen_specs(char* buffer)
+{
+	sprintf(buffer, "%i %i\n", resolution_x, resolution_y);
+}
+
+// Points the rasterizer at the buffer and clip window of the file
+// issuing the current command. Must be called with the video lock held.
+void select_context(video_context* ctx)
+{
+	if (ctx->layer == LAYER_FRONT)
+		draw_buffer = backend->front_buffer;
+	else
+		draw_buffer = backend->back_buffer;
+
+	clip_x0 = ctx->clip_x0;
+	clip_y0 = ctx->clip_y0;
+	clip_x1 = ctx->clip_x1;
+	clip_y1 = ctx->clip_y1;
+}
+
+void reset_clip(video_context* ctx)
+{
+	ctx->clip_x0 = 0;
+	ctx->clip_y0 = 0;
+	ctx->clip_x1 = resolution_x - 1;
+	ctx->clip_y1 = resolution_y - 1;
+}
+
+// Clip windows are kept inside the screen so the rasterizer
+// never has to check the screen bounds separately.
+void set_clip(video_context* ctx, int x0, int y0, int x1, int y1)
+{
+	if (x0 > x1)
+		swap_int(&x0, &x1);
+	if (y0 > y1)
+		swap_int(&y0, &y1);
+
+	ctx->clip_x0 = x0 < 0 ? 0 : x0;
+	ctx->clip_y0 = y0 < 0 ? 0 : y0;
+	ctx->clip_x1 = x1 >= resolution_x ? resolution_x - 1 : x1;
+	ctx->clip_y1 = y1 >= resolution_y ? resolution_y - 1 : y1;
+}
+
+// Runs one command from the context's buffer (already NUL terminated).
+// Returns 0, or a negative errno if the command could not be run.
+int video_process_command(video_context* ctx)
+{
+	char* msg = ctx->msg;
+	int err = 0;
+
+	// Commands that only change the context need no lock. Their counters
+	// are bumped without it too, so they may rarely miss a concurrent update.
+	if (!strncmp(msg, "color ", COLOR_CMD_PREAMBLE_SIZE))
+	{
+		count_command(CMD_COLOR);
+		if (kstrtoint(msg + COLOR_CMD_PREAMBLE_SIZE, 16, &ctx->color))
+			ctx->color = DEFAULT_COLOR;
+		return 0;
+	}
+	else if (!strncmp(msg, "clip ", CLIP_CMD_PREAMBLE_SIZE))
+	{
+		line_box_data clip = parse_line_box_command(msg, CLIP_CMD_PREAMBLE_SIZE, 0);
+		count_command(CMD_CLIP);
+		set_clip(ctx, clip.x0, clip.y0, clip.x1, clip.y1);
+		return 0;
+	}
+	else if (!strcmp(msg, "noclip"))
+	{
+		count_command(CMD_CLIP);
+		reset_clip(ctx);
+		return 0;
+	}
+	else if (!strcmp(msg, "layer front"))
+	{
+		count_command(CMD_LAYER);
+		ctx->layer = LAYER_FRONT;
+		return 0;
+	}
+	else if (!strcmp(msg, "layer back"))
+	{
+		count_command(CMD_LAYER);
+		ctx->layer = LAYER_BACK;
+		return 0;
+	}
+	else if (!strncmp(msg, "surface ", SURFACE_CMD_PREAMBLE_SIZE))
+	{
+		count_command(CMD_SURFACE);
+		return upload_surface(msg);
+	}
+
+	if ((err = video_lock()) != 0)
+		return err;
+
+	select_context(ctx);
+	execute_command(ctx);
+
+	video_unlock();
+
+	return 0;
+}
+
+// Runs a drawing command from the context's buffer. Must be called
+// with the video lock held, after select_context.
+void execute_command(video_context* ctx)
+{
+	char* msg = ctx->msg;
+
+	if (!strcmp(msg, "clear"))
+	{
+		count_command(CMD_CLEAR);
+		clear_screen();
+	}
+	else if (!strncmp(msg, "pixel ", PIXEL_CMD_PREAMBLE_SIZE))
+	{
+		pixel_data pixel = parse_pixel_command(msg, ctx->color);
+		count_command(CMD_PIXEL);
+		plot_pixel(pixel.x, pixel.y, pixel.color);
+	}
+	else if (!strncmp(msg, "line ", LINE_CMD_PREAMBLE_SIZE))
+	{
+		line_box_data line = parse_line_box_command(msg, LINE_CMD_PREAMBLE_SIZE, ctx->color);
+		count_command(CMD_LINE);
+		draw_line(line.x0, line.y0, line.x1, line.y1, line.color);
+	}
+	else if (!strncmp(msg, "box ", BOX_CMD_PREAMBLE_SIZE))
+	{
+		line_box_data box = parse_line_box_command(msg, BOX_CMD_PREAMBLE_SIZE, ctx->color);
+		count_command(CMD_BOX);
+		draw_box(box.x0, box.y0, box.x1, box.y1, box.color);
+	}
+	else if (!strcmp(msg, "sync"))
+	{
+		count_command(CMD_SYNC);
+		sync_loop();
+		// The swap changed which buffer is the back buffer
+		select_context(ctx);
+	}
+	else if (!strcmp(msg, "erase"))
+	{
+		count_command(CMD_ERASE);
+		erase_characters();
+	}
+	else if (!strncmp(msg, "text ", TEXT_CMD_PREAMBLE_SIZE))
+	{
+		text_data text = parse_text_command(msg);
+		count_command(CMD_TEXT);
+		write_text(text.x, text.y, text.string);
+	}
+	else if (!strncmp(msg, "wave ", WAVE_CMD_PREAMBLE_SIZE))
+	{
+		wave_data wave = parse_wave_command(msg, WAVE_CMD_PREAMBLE_SIZE,
+		                                    ctx->wave_points, MAX_WAVE_POINTS);
+		count_command(CMD_WAVE);
+		draw_wave(wave.x0, wave.x_step, wave.y, wave.n_points, wave.color);
+	}
+	else if (!strncmp(msg, "peaks ", PEAKS_CMD_PREAMBLE_SIZE))
+	{
+		wave_data peaks = parse_wave_command(msg, PEAKS_CMD_PREAMBLE_SIZE,
+		                                     ctx->wave_points, MAX_PEAK_POINTS);
+		count_command(CMD_PEAKS);
+		draw_peaks(peaks.x0, peaks.x_step, peaks.y, peaks.n_points / 2, peaks.color);
+	}
+	else if (!strncmp(msg, "textbox ", TEXTBOX_CMD_PREAMBLE_SIZE))
+	{
+		text_box_data text_box = parse_text_box_command(msg);
+		count_command(CMD_TEXTBOX);
+		write_text_box(text_box.x0, text_box.y0, text_box.x1, text_box.y1, text_box.string);
+	}
+	else if (!strncmp(msg, "cleartext ", CLEARTEXT_CMD_PREAMBLE_SIZE))
+	{
+		line_box_data rect = parse_line_box_command(msg, CLEARTEXT_CMD_PREAMBLE_SIZE, 0);
+		count_command(CMD_CLEARTEXT);
+		clear_text_rect(rect.x0, rect.y0, rect.x1, rect.y1);
+	}
+	else if (!strncmp(msg, "scroll ", SCROLL_CMD_PREAMBLE_SIZE))
+	{
+		int rows = 0;
+		count_command(CMD_SCROLL);
+		if (!kstrtoint(msg + SCROLL_CMD_PREAMBLE_SIZE, 10, &rows))
+			scroll_text(rows);
+	}
+	else if (!strncmp(msg, "log ", LOG_CMD_PREAMBLE_SIZE))
+	{
+		count_command(CMD_LOG);
+		log_text(msg + LOG_CMD_PREAMBLE_SIZE);
+	}
+	else if (!strncmp(msg, "blit ", BLIT_CMD_PREAMBLE_SIZE))
+	{
+		blit_data blit = parse_blit_command(msg);
+		count_command(CMD_BLIT);
+		if (blit.id >= 0 && blit.id < MAX_SURFACES)
+			blit_surface(&surfaces[blit.id], blit.x, blit.y, blit.use_key, blit.color_key);
+	}
+	else if (!strncmp(msg, "free ", FREE_CMD_PREAMBLE_SIZE))
+	{
+		int id = -1;
+		count_command(CMD_FREE);
+		if (!kstrtoint(msg + FREE_CMD_PREAMBLE_SIZE, 10, &id) && id >= 0 && id < MAX_SURFACES)
+		{
+			video_free(surfaces[id].pixels);
+			surfaces[id].pixels = NULL;
+		}
+	}
+	else
+		count_command(CMD_UNKNOWN);
+}
+
+void clear_screen(void)
+{
+	int y = 0;
+
+	for (y = clip_y0; y <= clip_y1; y++)
+		draw_hspan(clip_x0, clip_x1, y, 0);
+}
+
+// Returns the address of pixel (x,y) in the buffer currently being drawn.
+// Callers are expected to have clipped the coordinates already.
+short int* pixel_address(int x, int y)
+{
+	return draw_buffer + x + y * backend->pixel_row_stride;
+}
+
+void plot_pixel(int x, int y, short int color)
+{
+	if (x < clip_x0 || x > clip_x1 || y < clip_y0 || y > clip_y1)
+		return;
+
+	*pixel_address(x, y) = color;
+	stats.pixels++;
+}
+
+// Fills the horizontal span x0..x1 (inclusive) on row y.
+void draw_hspan(int x0, int x1, int y, short int color)
+{
+	short int* pixel = NULL;
+	short int* last = NULL;
+
+	if (x0 > x1)
+		swap_int(&x0, &x1);
+	if (y < clip_y0 || y > clip_y1 || x1 < clip_x0 || x0 > clip_x1)
+		return;
+	if (x0 < clip_x0)
+		x0 = clip_x0;
+	if (x1 > clip_x1)
+		x1 = clip_x1;
+
+	stats.pixels += x1 - x0 + 1;
+	pixel = pixel_address(x0, y);
+	last = pixel + (x1 - x0);
+	while (pixel <= last)
+		*pixel++ = color;
+}
+
+// Fills the vertical span y0..y1 (inclusive) on column x.
+void draw_vspan(int x, int y0, int y1, short int color)
+{
+	short int* pixel = NULL;
+	int n = 0;
+
+	if (y0 > y1)
+		swap_int(&y0, &y1);
+	if (x < clip_x0 || x > clip_x1 || y1 < clip_y0 || y0 > clip_y1)
+		return;
+	if (y0 < clip_y0)
+		y0 = clip_y0;
+	if (y1 > clip_y1)
+		y1 = clip_y1;
+
+	stats.pixels += y1 - y0 + 1;
+	pixel = pixel_address(x, y0);
+	for (n = y1 - y0; n >= 0; n--)
+	{
+		*pixel = color;
+		pixel += backend->pixel_row_stride;
+	}
+}
+
+int compute_outcode(long long x, long long y)
+{
+	int code = OUT_INSIDE;
+
+	if (x < clip_x0)
+		code |= OUT_LEFT;
+	else if (x > clip_x1)
+		code |= OUT_RIGHT;
+	if (y < clip_y0)
+		code |= OUT_TOP;
+	else if (y > clip_y1)
+		code |= OUT_BOTTOM;
+
+	return code;
+}
+
+// Cohen-Sutherland clipping of the segment against the clip window.
+// Works in 64 bits, so endpoints anywhere in the int range keep the
+// segment's slope. Returns 0 if nothing of the segment is left to draw.
+int clip_line(long long* x0, long long* y0, long long* x1, long long* y1)
+{
+	int code0 = 0;
+	int code1 = 0;
+	int code = 0;
+	long long x = 0;
+	long long y = 0;
+
+	code0 = compute_outcode(*x0, *y0);
+	code1 = compute_outcode(*x1, *y1);
+
+	while (1)
+	{
+		if (!(code0 | code1))
+			return 1;
+		if (code0 & code1)
+			return 0;
+
+		code = code0 ? code0 : code1;
+
+		if (code & OUT_BOTTOM)
+		{
+			y = clip_y1;
+			x = *x0 + scale_delta(*x1 - *x0, y - *y0, *y1 - *y0);
+		}
+		else if (code & OUT_TOP)
+		{
+			y = clip_y0;
+			x = *x0 + scale_delta(*x1 - *x0, y - *y0, *y1 - *y0);
+		}
+		else if (code & OUT_RIGHT)
+		{
+			x = clip_x1;
+			y = *y0 + scale_delta(*y1 - *y0, x - *x0, *x1 - *x0);
+		}
+		else
+		{
+			x = clip_x0;
+			y = *y0 + scale_delta(*y1 - *y0, x - *x0, *x1 - *x0);
+		}
+
+		if (code == code0)
+		{
+			*x0 = x;
+			*y0 = y;
+			code0 = compute_outcode(x, y);
+		}
+		else
+		{
+			*x1 = x;
+			*y1 = y;
+			code1 = compute_outcode(x, y);
+		}
+	}
+}
+
+// delta * num / den rounded toward zero, for a clip boundary lying on
+// the segment (|num| <= |den|). The clip boundary lies between the
+// endpoints, so with int coordinates every magnitude fits in 32 bits and
+// the product in an unsigned 64-bit one.
+long long scale_delta(long long delta, long long num, long long den)
+{
+	int negative = (delta < 0) ^ (num < 0) ^ (den < 0);
+	unsigned long long product = 0;
+	unsigned long long quotient = 0;
+
+	product = (unsigned long long) (delta < 0 ? -delta : delta) * (num < 0 ? -num : num);
+	quotient = video_div64(product, (unsigned int) (den < 0 ? -den : den));
+
+	return negative ? -(long long) quotient : (long long) quotient;
+}
+
+void draw_line(int x0, int y0, int x1, int y1, short int color)
+{
+	long long end_x0 = x0, end_y0 = y0, end_x1 = x1, end_y1 = y1;
+	int deltax = 0;
+	int deltay = 0;
+	int error = 0;
+	int n = 0;
+	int major_step = 0;
+	int minor_step = 0;
+	short int* pixel = NULL;
+
+	if (!clip_line(&end_x0, &end_y0, &end_x1, &end_y1))
+		return;
+	x0 = end_x0;
+	y0 = end_y0;
+	x1 = end_x1;
+	y1 = end_y1;
+
+	// Axis aligned lines are plain fills.
+	if (y0 == y1)
+	{
+		draw_hspan(x0, x1, y0, color);
+		return;
+	}
+	if (x0 == x1)
+	{
+		draw_vspan(x0, y0, y1, color);
+		return;
+	}
+
+	deltax = abs(x1 - x0);
+	deltay = abs(y1 - y0);
+
+	// Bresenham walking a raw pointer: one step along the major
+	// axis per pixel, plus a step along the minor axis whenever
+	// the error term overflows.
+	pixel = pixel_address(x0, y0);
+	if (deltax >= deltay)
+	{
+		major_step = (x1 > x0) ? 1 : -1;
+		minor_step = (y1 > y0) ? backend->pixel_row_stride : -backend->pixel_row_stride;
+	}
+	else
+	{
+		major_step = (y1 > y0) ? backend->pixel_row_stride : -backend->pixel_row_stride;
+		minor_step = (x1 > x0) ? 1 : -1;
+		swap_int(&deltax, &deltay);
+	}
+
+	stats.pixels += deltax + 1;
+	error = -(deltax / 2);
+	for (n = deltax; n >= 0; n--)
+	{
+		*pixel = color;
+		pixel += major_step;
+		error += deltay;
+
+		if (error > 0)
+		{
+			pixel += minor_step;
+			error -= deltax;
+		}
+	}
+}
+
+// draw_line for endpoints past the int range, as a wave's far samples
+// can be. Once clipped, the segment is on screen and fits draw_line.
+void draw_segment(long long x0, long long y0, long long x1, long long y1, short int color)
+{
+	if (clip_line(&x0, &y0, &x1, &y1))
+		draw_line(x0, y0, x1, y1, color);
+}
+
+void draw_box(int x0, int y0, int x1, int y1, short int color)
+{
+	int i = 0;
+
+	if (y0 > y1)
+		swap_int(&y1, &y0);
+	if (y0 < clip_y0)
+		y0 = clip_y0;
+	if (y1 > clip_y1)
+		y1 = clip_y1;
+
+	for(i=y0; i<=y1; i++){
+		draw_hspan(x0, x1, i, color);
+	}
+}
+
+// Draws the connected trace (x0 + i*x_step, y[i]) for every sample,
+// so a whole waveform frame costs a single write() from the client.
+void draw_wave(int x0, int x_step, int* y, int n_points, short int color)
+{
+	int i = 0;
+
+	if (n_points == 1)
+		plot_pixel(x0, y[0], color);
+
+	// In 64 bits, as i*x_step from a client can overflow an int
+	for (i = 0; i < n_points - 1; i++)
+		draw_segment(x0 + (long long) i * x_step, y[i],
+			x0 + (long long) (i+1) * x_step, y[i+1], color);
+}
+
+// Draws a decimated trace: column i spans the pair y[2i], y[2i+1], the
+// extremes of the samples it stands for. Columns whose spans do not
+// overlap are joined by a line between their nearest ends, so steep
+// edges stay connected.
+void draw_peaks(int x0, int x_step, int* y, int n_columns, short int color)
+{
+	int lo = 0, hi = 0, next_lo = 0, next_hi = 0;
+	long long x = x0; // a client's x_step can take it past the int range
+	int i = 0;
+
+	for (i = 0; i < n_columns; i++, x += x_step)
+	{
+		lo = y[2*i] < y[2*i+1] ? y[2*i] : y[2*i+1];
+		hi = y[2*i] < y[2*i+1] ? y[2*i+1] : y[2*i];
+		if (x >= clip_x0 && x <= clip_x1)
+			draw_vspan(x, lo, hi, color);
+
+		if (i == n_columns - 1)
+			break;
+		next_lo = y[2*i+2] < y[2*i+3] ? y[2*i+2] : y[2*i+3];
+		next_hi = y[2*i+2] < y[2*i+3] ? y[2*i+3] : y[2*i+2];
+		if (hi < next_lo)
+			draw_segment(x, hi, x + x_step, next_lo, color);
+		else if (lo > next_hi)
+			draw_segment(x, lo, x + x_step, next_hi, color);
+	}
+}
+
+// Copies a stored surface to x,y of the draw buffer, clipped against
+// the clip window. Opaque surfaces are copied a whole row at a time.
+// With use_key set, pixels equal to color_key are left untouched.
+void blit_surface(surface* src, int x, int y, int use_key, short int color_key)
+{
+	int src_x0 = 0;
+	int src_y0 = 0;
+	int width = 0;
+	int height = 0;
+	int row = 0;
+	int i = 0;
+	short int* src_row = NULL;
+	short int* dst_row = NULL;
+
+	if (src->pixels == NULL)
+		return;
+
+	width = src->width;
+	height = src->height;
+
+	// Compared so that nothing overflows, whatever x and y the client sent
+	if (x < clip_x0)
+	{
+		if (x <= clip_x0 - width)
+			return;
+		src_x0 = clip_x0 - x;
+		width -= src_x0;
+		x = clip_x0;
+	}
+	if (y < clip_y0)
+	{
+		if (y <= clip_y0 - height)
+			return;
+		src_y0 = clip_y0 - y;
+		height -= src_y0;
+		y = clip_y0;
+	}
+	if (width > clip_x1 - x + 1)
+		width = clip_x1 - x + 1;
+	if (height > clip_y1 - y + 1)
+		height = clip_y1 - y + 1;
+	if (width <= 0 || height <= 0)
+		return;
+
+	stats.pixels += width * height;
+	src_row = src->pixels + src_y0 * src->width + src_x0;
+	dst_row = pixel_address(x, y);
+
+	for (row = 0; row < height; row++)
+	{
+		if (!use_key)
+			video_memcpy_toio(dst_row, src_row, width * sizeof(short int));
+		else
+			for (i = 0; i < width; i++)
+				if (src_row[i] != color_key)
+					dst_row[i] = src_row[i];
+
+		src_row += src->width;
+		dst_row += backend->pixel_row_stride;
+	}
+}
+
+void free_surfaces(void)
+{
+	int i = 0;
+
+	for (i = 0; i < MAX_SURFACES; i++)
+	{
+		video_free(surfaces[i].pixels);
+		surfaces[i].pixels = NULL;
+	}
+}
+
+void sync_loop(void)
+{
+	long long start = video_time_us();
+
+	backend->swap(backend);
+	record_sync(start, video_time_us());
+}
+
+// Accounts for a swap requested at start and completed at end (both
+// in microseconds). Must be called with the video lock held.
+void record_sync(long long start, long long end)
+{
+	long wait = end - start;
+	long interval = 0;
+
+	stats.syncs++;
+	stats.swap_wait_total_us += wait;
+	if (stats.syncs == 1 || wait < stats.swap_wait_min_us)
+		stats.swap_wait_min_us = wait;
+	if (wait > stats.swap_wait_max_us)
+		stats.swap_wait_max_us = wait;
+	if (wait > FRAME_PERIOD_US)
+		stats.late_frames++;
+
+	// Every refresh between two syncs beyond the first one showed the
+	// same frame again. Long gaps mean the client was idle, not slow.
+	if (stats.last_sync_us != 0 && end - stats.last_sync_us < IDLE_GAP_US)
+	{
+		interval = end - stats.last_sync_us;
+		if (interval >= 2 * FRAME_PERIOD_US)
+			stats.dropped_frames += interval / FRAME_PERIOD_US - 1;
+	}
+	stats.last_sync_us = end;
+
+	if (end - stats.fps_window_us >= 1000000)
+	{
+		stats.fps = (end - stats.fps_window_us < 2000000) ? stats.fps_window_syncs : 0;
+		stats.fps_window_us = end;
+		stats.fps_window_syncs = 0;
+	}
+	stats.fps_window_syncs++;
+
+	if (stats.frame_commands > stats.max_frame_commands)
+		stats.max_frame_commands = stats.frame_commands;
+	stats.frame_commands = 0;
+}
+
+void count_command(command_type type)
+{
+	stats.commands[type]++;
+	stats.frame_commands++;
+}
+
+// Prints the statistics as "name value" lines into buf (size bytes).
+// Returns the length of the text. Must be called with the video lock held.
+int video_format_stats(char* buf, int size)
+{
+	int length = 0;
+	int i = 0;
+	unsigned long commands = 0;
+
+	for (i = 0; i < CMD_TYPES; i++)
+		commands += stats.commands[i];
+
+	length += scnprintf(buf + length, size - length,
+	                    "syncs %lu\nfps %lu\nlate_frames %lu\ndropped_frames %lu\n",
+	                    stats.syncs, stats.fps, stats.late_frames, stats.dropped_frames);
+	length += scnprintf(buf + length, size - length,
+	                    "swap_wait_min_us %ld\nswap_wait_avg_us %llu\nswap_wait_max_us %ld\n",
+	                    stats.swap_wait_min_us,
+	                    stats.syncs ? video_div64(stats.swap_wait_total_us, stats.syncs) : 0,
+	                    stats.swap_wait_max_us);
+	length += scnprintf(buf + length, size - length,
+	                    "commands %lu\nmax_commands_per_frame %lu\npixels %llu\n",
+	                    commands, stats.max_frame_commands, stats.pixels);
+	for (i = 0; i < CMD_TYPES; i++)
+		length += scnprintf(buf + length, size - length, "cmd_%s %lu\n",
+		                    command_names[i], stats.commands[i]);
+
+	return length;
+}
+
+pixel_data parse_pixel_command(char* command, int default_color)
+{
+	// When this function is called, we already know the command starts with "pixel "
+
+	pixel_data pixel = {0, 0, 0};
+	int err = 0;
+	char* arguments = command + PIXEL_CMD_PREAMBLE_SIZE;
+	char* comma_pos = strchr(arguments, ',');
+	char* space_pos = strchr(arguments, ' ');
+
+	// Input is not correctly formatted
+	if (comma_pos == NULL)
+		return pixel;
+
+	// Without a color argument, the context color is used
+	if (space_pos == NULL)
+	{
+		pixel.color = default_color;
+		err |= kstrtoint(comma_pos+1, 10, &pixel.y);
+		*comma_pos = '\0';
+		err |= kstrtoint(arguments, 10, &pixel.x);
+		if (err)
+			pixel.color = 0;
+		return pixel;
+	}
+
+	// By moving the \0 to the position of the space and the comma
+	// in the argument string we create substrings that are parsed
+	// by the kstrtoint function. If the function fails, it means
+	// there is a syntatic error in the command, and then a default
+	// pixel is returned
+	err = kstrtoint(space_pos+1, 16, &pixel.color);
+	*space_pos = '\0';
+	err |= kstrtoint(comma_pos+1, 10, &pixel.y);
+	*comma_pos = '\0';
+	err |= kstrtoint(arguments, 10, &pixel.x);
+
+	// If the color input is not a valid hex number, the  pixel 0,0
+	// is set to black. This may be  inconvenient for the user, but
+	// it is a way of communicating to the client that something is
+	// wrong in the application layer.
+	if (err)
+	{
+		pixel.x = 0;
+		pixel.y = 0;
+		pixel.color = 0;
+	}
+
+	return pixel;
+}
+
+text_data parse_text_command(char* command)
+{
+	// When this function is called, we already know the command starts with "text "
+
+	text_data text = {0, 0, " "};
+	int err = 0;
+	char* arguments = command + TEXT_CMD_PREAMBLE_SIZE;
+	char* comma_pos = strchr(arguments, ',');
+	char* space_pos = strchr(arguments, ' ');
+
+	// Input is not correctly formatted
+	if (comma_pos == NULL || space_pos == NULL)
+		return text;
+
+	// By moving the \0 to the position of the space and the comma
+	// in the argument string we create substrings that are parsed
+	// by the kstrtoint function. If the function fails, it means
+	// there is a syntatic error in the command, and then a default
+	// text is returned
+	text.string = space_pos + 1;
+	*space_pos = '\0';
+	err |= kstrtoint(comma_pos+1, 10, &text.y);
+	*comma_pos = '\0';
+	err |= kstrtoint(arguments, 10, &text.x);
+
+
+	// Forcing string limitation based on the resolution.
+	if (text.x >= c_resolution_x)
+		text.x = c_resolution_x - 1;
+	if (text.y >= c_resolution_y)
+		text.y = c_resolution_y - 1;
+
+	// If x and y inputs are not valid numbers, the  position 0,0
+	// is set to " ". This may be  inconvenient for the user, but
+	// it is a way of communicating to the client that something is
+	// wrong in the application layer.
+	if (err)
+	{
+		text.x = 0;
+		text.y = 0;
+		text.string = " ";
+	}
+
+	return text;
+}
+
+wave_data parse_wave_command(char* command, int preamble_size, int* points, int max_points)
+{
+	// When this function is called, we already know the command starts with "wave " or "peaks "
+	// Format: "wave x0,x_step color y0 y1 y2 ... yn"
+	//         "peaks x0,x_step color min0 max0 min1 max1 ... minn maxn"
+
+	wave_data wave = {0, 1, 0, 0, points};
+	int err = 0;
+	char* arguments = command + preamble_size;
+	char* comma_pos = strchr(arguments, ',');
+	char* space_pos = strchr(arguments, ' ');
+	char* color_pos = NULL;
+	char* sample = NULL;
+
+	// Input is not correctly formatted
+	if (comma_pos == NULL || space_pos == NULL || comma_pos > space_pos)
+		return wave;
+
+	*space_pos = '\0';
+	*comma_pos = '\0';
+	err |= kstrtoint(arguments, 10, &wave.x0);
+	err |= kstrtoint(comma_pos+1, 10, &wave.x_step);
+
+	color_pos = space_pos + 1;
+	arguments = strchr(color_pos, ' ');
+	if (arguments == NULL)
+		return wave;
+	*arguments++ = '\0';
+	err |= kstrtoint(color_pos, 16, &wave.color);
+
+	// A malformed header draws nothing, rather than a trace
+	// in the wrong place or colour.
+	if (err)
+		return wave;
+
+	while ((sample = strsep(&arguments, " ")) != NULL && wave.n_points < max_points)
+	{
+		if (*sample == '\0')
+			continue;
+		if (kstrtoint(sample, 10, &wave.y[wave.n_points]))
+			break;
+		wave.n_points++;
+	}
+
+	return wave;
+}
+
+// Parses "surface id w,h p0 p1 ... pn" (hex RGB565 pixels, row-major)
+// and stores it in slot id, replacing any surface already there.
+// Returns 0 on success or a negative errno.
+int upload_surface(char* command)
+{
+	int id = 0;
+	int width = 0;
+	int height = 0;
+	int n_pixels = 0;
+	int color = 0;
+	int err = 0;
+	short int* pixels = NULL;
+	short int* old_pixels = NULL;
+	char* arguments = command + SURFACE_CMD_PREAMBLE_SIZE;
+	char* token = NULL;
+
+	token = strsep(&arguments, " ");
+	err |= kstrtoint(token, 10, &id);
+	token = strsep(&arguments, ",");
+	if (token == NULL || arguments == NULL)
+		return -EINVAL;
+	err |= kstrtoint(token, 10, &width);
+	token = strsep(&arguments, " ");
+	err |= kstrtoint(token, 10, &height);
+
+	if (err || id < 0 || id >= MAX_SURFACES || width <= 0 || height <= 0 ||
+	    width * height > MAX_SURFACE_PIXELS || arguments == NULL)
+		return -EINVAL;
+
+	pixels = video_malloc(width * height * sizeof(short int));
+	if (pixels == NULL)
+		return -ENOMEM;
+
+	while ((token = strsep(&arguments, " ")) != NULL && n_pixels < width * height)
+	{
+		if (*token == '\0')
+			continue;
+		if (kstrtoint(token, 16, &color))
+			break;
+		pixels[n_pixels++] = color;
+	}
+
+	// Pixels missing from a short upload are left black
+	while (n_pixels < width * height)
+		pixels[n_pixels++] = 0;
+
+	if (video_lock())
+	{
+		video_free(pixels);
+		return -ERESTARTSYS;
+	}
+	old_pixels = surfaces[id].pixels;
+	surfaces[id].pixels = pixels;
+	surfaces[id].width = width;
+	surfaces[id].height = height;
+	video_unlock();
+
+	video_free(old_pixels);
+
+	return 0;
+}
+
+blit_data parse_blit_command(char* command)
+{
+	// When this function is called, we already know the command starts with "blit "
+	// Format: "blit id x,y [color_key]"
+
+	blit_data blit = {-1, 0, 0, 0, 0};
+	int err = 0;
+	char* arguments = command + BLIT_CMD_PREAMBLE_SIZE;
+	char* id_pos = strsep(&arguments, " ");
+	char* x_pos = NULL;
+	char* y_pos = NULL;
+
+	if (arguments == NULL)
+		return blit;
+
+	x_pos = strsep(&arguments, ",");
+	if (arguments == NULL)
+		return blit;
+	y_pos = strsep(&arguments, " ");
+
+	err |= kstrtoint(id_pos, 10, &blit.id);
+	err |= kstrtoint(x_pos, 10, &blit.x);
+	err |= kstrtoint(y_pos, 10, &blit.y);
+
+	if (arguments != NULL && *arguments != '\0')
+	{
+		err |= kstrtoint(arguments, 16, &blit.color_key);
+		blit.use_key = 1;
+	}
+
+	// A malformed blit draws nothing
+	if (err)
+		blit.id = -1;
+
+	return blit;
+}
+
+text_box_data parse_text_box_command(char* command)
+{
+	// When this function is called, we already know the command starts with "textbox "
+	// Format: "textbox x0,y0 x1,y1 string"
+
+	text_box_data text_box = {0, 0, 0, 0, ""};
+	int err = 0;
+	char* arguments = command + TEXTBOX_CMD_PREAMBLE_SIZE;
+	char* x0_pos = strsep(&arguments, ",");
+	char* y0_pos = arguments ? strsep(&arguments, " ") : NULL;
+	char* x1_pos = arguments ? strsep(&arguments, ",") : NULL;
+	char* y1_pos = arguments ? strsep(&arguments, " ") : NULL;
+
+	// Input is not correctly formatted
+	if (y1_pos == NULL)
+		return text_box;
+
+	err |= kstrtoint(x0_pos, 10, &text_box.x0);
+	err |= kstrtoint(y0_pos, 10, &text_box.y0);
+	err |= kstrtoint(x1_pos, 10, &text_box.x1);
+	err |= kstrtoint(y1_pos, 10, &text_box.y1);
+
+	// Like the text command, a malformed box writes nothing useful
+	if (err)
+	{
+		text_box.x0 = text_box.y0 = text_box.x1 = text_box.y1 = 0;
+		return text_box;
+	}
+
+	text_box.string = arguments ? arguments : "";
+
+	return text_box;
+}
+
+line_box_data parse_line_box_command(char* command, int preamble_size, int default_color)
+{
+	// Format: "<cmd> x0,y0 x1,y1 [color]". Without a color argument
+	// the context color is used.
+
+	line_box_data line = {0, 0, 0, 0, 0};
+	int err = 0;
+	char* arguments = command + preamble_size;
+	char* comma = NULL;
+
+	char* point_space = strchr(arguments, ' ');
+	if (point_space == NULL)
+		return line;
+	*point_space = '\0';
+	comma = strchr(arguments, ',');
+	if (comma == NULL)
+		return line;
+	*comma = '\0';
+	err = kstrtoint(arguments, 10, &line.x0);
+	err |= kstrtoint(comma+1, 10, &line.y0);
+
+	arguments = point_space+1;
+
+	point_space = strchr(arguments, ' ');
+	if (point_space != NULL)
+		*point_space = '\0';
+	comma = strchr(arguments, ',');
+	if (comma == NULL)
+		return line;
+	*comma = '\0';
+	err |= kstrtoint(arguments, 10, &line.x1);
+	err |= kstrtoint(comma+1, 10, &line.y1);
+
+	if (point_space != NULL)
+		err |= kstrtoint(point_space+1, 16, &line.color);
+	else
+		line.color = default_color;
+
+	// A malformed command collapses to a black dot at 0,0, the
+	// same way a malformed pixel command does.
+	if (err)
+	{
+		line.x0 = line.y0 = line.x1 = line.y1 = 0;
+		line.color = 0;
+	}
+
+	return line;
+}
+
+char* char_address(int x, int y)
+{
+	return backend->char_buffer + x + y * backend->char_row_stride;
+}
+
+void put_char(int x, int y, char character_in)
+{
+	if (x < 0 || x >= c_resolution_x || y < 0 || y >= c_resolution_y)
+		return;
+
+	*char_address(x, y) = character_in;
+}
+
+void erase_characters(void)
+{
+	clear_text_rect(0, 0, c_resolution_x - 1, c_resolution_y - 1);
+}
+
+// Blanks the character rectangle x0,y0..x1,y1 (inclusive), one row at a time.
+void clear_text_rect(int x0, int y0, int x1, int y1)
+{
+	int y = 0;
+
+	if (x0 > x1)
+		swap_int(&x0, &x1);
+	if (y0 > y1)
+		swap_int(&y0, &y1);
+	if (x0 < 0)
+		x0 = 0;
+	if (y0 < 0)
+		y0 = 0;
+	if (x1 >= c_resolution_x)
+		x1 = c_resolution_x - 1;
+	if (y1 >= c_resolution_y)
+		y1 = c_resolution_y - 1;
+	if (x0 > x1 || y0 > y1)
+		return;
+
+	for (y = y0; y <= y1; y++)
+		video_memset_io(char_address(x0, y), ' ', x1 - x0 + 1);
+}
+
+// Moves the whole character buffer up by rows lines and blanks the
+// rows uncovered at the bottom. Device memory has no memmove, so the rows
+// go through a bounce buffer, top first, as each lands above its source.
+void scroll_text(int rows)
+{
+	char bounce[SCROLL_BOUNCE_SIZE];
+	int run = 0;
+	int x = 0;
+	int y = 0;
+
+	if (rows <= 0)
+		return;
+	if (rows >= c_resolution_y)
+	{
+		erase_characters();
+		return;
+	}
+
+	for (y = 0; y < c_resolution_y - rows; y++)
+		for (x = 0; x < c_resolution_x; x += run)
+		{
+			run = c_resolution_x - x;
+			if (run > SCROLL_BOUNCE_SIZE)
+				run = SCROLL_BOUNCE_SIZE;
+			video_memcpy_fromio(bounce, char_address(x, y + rows), run);
+			video_memcpy_toio(char_address(x, y), bounce, run);
+		}
+	clear_text_rect(0, c_resolution_y - rows, c_resolution_x - 1, c_resolution_y - 1);
+}
+
+// Console style output: scrolls up one line and writes string on the
+// bottom row, truncated to the screen width.
+void log_text(char* string)
+{
+	int length = strlen(string);
+
+	if (length > c_resolution_x)
+		length = c_resolution_x;
+
+	scroll_text(1);
+	video_memcpy_toio(char_address(0, c_resolution_y - 1), string, length);
+}
+
+// Writes string starting at x,y, wrapping to the next row (and back to
+// the top of the screen) at the right edge. Each row is copied in one go.
+void write_text(int x, int y, char* string)
+{
+	int remaining = strlen(string);
+	int run = 0;
+
+	if (x < 0)
+		x = 0;
+	if (y < 0)
+		y = 0;
+
+	while (remaining > 0)
+	{
+		run = c_resolution_x - x;
+		if (run > remaining)
+			run = remaining;
+
+		video_memcpy_toio(char_address(x, y), string, run);
+		string += run;
+		remaining -= run;
+
+		x = 0;
+		y++;
+		if (y > c_resolution_y - 1)
+			y = 0;
+	}
+}
+
+// Fills the rectangle x0,y0..x1,y1 with string, wrapping at x1. The
+// part of the rectangle the string does not reach is blanked.
+void write_text_box(int x0, int y0, int x1, int y1, char* string)
+{
+	int remaining = strlen(string);
+	int width = 0;
+	int run = 0;
+	int y = 0;
+
+	clear_text_rect(x0, y0, x1, y1);
+
+	if (x0 > x1)
+		swap_int(&x0, &x1);
+	if (y0 > y1)
+		swap_int(&y0, &y1);
+	if (x0 < 0)
+		x0 = 0;
+	if (y0 < 0)
+		y0 = 0;
+	if (x1 >= c_resolution_x)
+		x1 = c_resolution_x - 1;
+	if (y1 >= c_resolution_y)
+		y1 = c_resolution_y - 1;
+
+	width = x1 - x0 + 1;
+	for (y = y0; y <= y1 && remaining > 0 && width > 0; y++)
+	{
+		run = remaining > width ? width : remaining;
+		video_memcpy_toio(char_address(x0, y), string, run);
+		string += run;
+		remaining -= run;
+	}
+}
+
+void swap_int(int* a, int* b)
+{
+	int temp = *a;
+	*a = *b;
+	*b = temp;
+}
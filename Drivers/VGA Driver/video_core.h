@@ -0,0 +1,179 @@
+#ifndef _VIDEO_CORE_
+#define _VIDEO_CORE_
+
+#define MAX_SIZE 8192+1 // large enough for a full-screen "wave" or a full "surface" upload
+#define MAX_WAVE_POINTS 320
+#define MAX_PEAK_POINTS (2 * MAX_WAVE_POINTS) // a min and a max per column
+#define DEFAULT_COLOR 0xFFFF
+#define LAYER_BACK 0 // draw into the back buffer, shown on the next sync
+#define LAYER_FRONT 1 // draw straight into the buffer on screen
+#define MAX_SURFACES 16
+#define MAX_SURFACE_PIXELS 1024 // e.g. 32x32
+#define FRAME_PERIOD_US 16667 // one refresh of the 60 Hz VGA output
+#define IDLE_GAP_US 1000000 // longer gaps between syncs are idle, not dropped frames
+#define MAX_STATS_SIZE 4096 // fits in the PAGE_SIZE buffer sysfs hands out
+
+// Command types counted in video_stats
+typedef enum command_type
+{
+	CMD_CLEAR,
+	CMD_PIXEL,
+	CMD_LINE,
+	CMD_BOX,
+	CMD_SYNC,
+	CMD_ERASE,
+	CMD_TEXT,
+	CMD_WAVE,
+	CMD_PEAKS,
+	CMD_TEXTBOX,
+	CMD_CLEARTEXT,
+	CMD_SCROLL,
+	CMD_LOG,
+	CMD_BLIT,
+	CMD_FREE,
+	CMD_COLOR,
+	CMD_CLIP,
+	CMD_LAYER,
+	CMD_SURFACE,
+	CMD_UNKNOWN,
+	CMD_TYPES
+} command_type;
+
+typedef struct pixel_data
+{
+	int x, y, color;
+} pixel_data;
+
+typedef struct line_box_data
+{
+	int x0, y0, x1, y1, color;
+} line_box_data;
+
+typedef struct text_data
+{
+	int x, y;
+	char *string;
+} text_data;
+
+typedef struct text_box_data
+{
+	int x0, y0, x1, y1;
+	char *string;
+} text_box_data;
+
+typedef struct wave_data
+{
+	int x0, x_step, color, n_points;
+	int *y;
+} wave_data;
+
+typedef struct blit_data
+{
+	int id, x, y, color_key, use_key;
+} blit_data;
+
+// Off-screen bitmap that clients upload once and blit many times
+typedef struct surface
+{
+	int width, height;
+	short int *pixels; // NULL while the slot is free
+} surface;
+
+// Where the core draws. The kernel driver provides one backed by the
+// FPGA pixel/character buffers; video_soft.c provides one in memory.
+typedef struct video_backend
+{
+	int resolution_x, resolution_y;
+	int c_resolution_x, c_resolution_y;
+	int pixel_row_stride; // pixels between the start of two rows
+	int char_row_stride; // characters between the start of two rows
+	short int *back_buffer; // drawn into, shown after the next swap
+	short int *front_buffer; // currently on screen
+	char *char_buffer;
+	// Shows the back buffer and updates back_buffer/front_buffer
+	void (*swap)(struct video_backend*);
+} video_backend;
+
+// Display throughput counters, shared by every open file and
+// protected by the video lock.
+typedef struct video_stats
+{
+	unsigned long commands[CMD_TYPES];
+	unsigned long long pixels; // pixels written by the rasterizer and blits
+	unsigned long syncs;
+	unsigned long late_frames; // swaps that waited longer than a frame period
+	unsigned long dropped_frames; // refreshes that showed the previous frame again
+	unsigned long long swap_wait_total_us;
+	long swap_wait_min_us, swap_wait_max_us;
+	unsigned long frame_commands; // commands since the last sync
+	unsigned long max_frame_commands;
+	long long last_sync_us; // time the previous swap completed, 0 before the first
+	long long fps_window_us; // start of the current one second window
+	unsigned long fps_window_syncs;
+	unsigned long fps; // syncs during the last complete window
+} video_stats;
+
+// Per open file drawing state
+typedef struct video_context
+{
+	char msg[MAX_SIZE]; // private command buffer
+	int wave_points[MAX_PEAK_POINTS];
+	int color; // used by pixel/line/box commands that omit a color
+	int clip_x0, clip_y0, clip_x1, clip_y1;
+	int layer;
+#ifdef __KERNEL__
+	struct mutex lock; // threads sharing the file take turns with msg
+#endif
+} video_context;
+
+void video_set_backend(video_backend*);
+void init_context(video_context*);
+int video_process_command(video_context*);
+void get_screen_specs(char*);
+void select_context(video_context*);
+void reset_clip(video_context*);
+void set_clip(video_context*, int, int, int, int);
+void execute_command(video_context*);
+void clear_screen(void);
+short int* pixel_address(int, int);
+void plot_pixel(int, int, short int);
+void draw_hspan(int, int, int, short int);
+void draw_vspan(int, int, int, short int);
+int compute_outcode(long long, long long);
+int clip_line(long long*, long long*, long long*, long long*);
+long long scale_delta(long long, long long, long long);
+void draw_line(int, int, int, int, short int);
+void draw_segment(long long, long long, long long, long long, short int);
+void draw_box(int, int, int, int, short int);
+void draw_wave(int, int, int*, int, short int);
+void draw_peaks(int, int, int*, int, short int);
+void blit_surface(surface*, int, int, int, short int);
+void free_surfaces(void);
+int upload_surface(char*);
+blit_data parse_blit_command(char*);
+void sync_loop(void);
+void record_sync(long long, long long);
+void count_command(command_type);
+int video_format_stats(char*, int);
+char* char_address(int, int);
+void put_char(int, int, char);
+void erase_characters(void);
+void clear_text_rect(int, int, int, int);
+void scroll_text(int);
+void log_text(char*);
+void write_text(int, int, char*);
+void write_text_box(int, int, int, int, char*);
+pixel_data parse_pixel_command(char*, int);
+line_box_data parse_line_box_command(char*, int, int);
+text_data parse_text_command(char*);
+text_box_data parse_text_box_command(char*);
+wave_data parse_wave_command(char*, int, int*, int);
+
+void swap_int(int*, int*);
+
+// Provided by whoever embeds the core, to serialize drawing between
+// contexts. video_lock returns 0, or a negative errno if interrupted.
+int video_lock(void);
+void video_unlock(void);
+
+#endif
@@ -0,0 +1,294 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+#include "address_map_arm.h"
+#include "pixel_ctrl_map.h"
+#include "char_ctrl_map.h"
+#include "video.h"
+
+#define DOUBLE_BUFFER 1
+#define DEVICE_NAME "video"
+#define CHAR_ROW_STRIDE 128 // characters between rows of the character buffer
+#define PIXEL_ROW_STRIDE 512 // pixels between rows of the pixel buffer
+#define SUCCESS 0
+
+// Declare global variables needed to use the pixel buffer
+void *LW_virtual; // used to access FPGA light-weight bridge
+void *SDRAM_virtual; // used to access the SDRAM
+volatile int * pixel_ctrl_ptr; // virtual address of pixel buffer controller
+volatile int * char_ctrl_ptr; // virtual address of the character buffer controller
+short int * pixel_buffer; // used for virtual address of pixel buffer
+char * char_buffer; // used for virtual address of character buffer
+short int * pixel_back_buffer; // used for virtual address of pixel back buffer
+
+// The drawing core (video_core.c) renders through this backend
+static video_backend hw_backend;
+
+// Declare variables needed for a character device driver
+
+static dev_t dev_no = 0;
+static struct cdev *cdev = NULL;
+static struct class *class = NULL;
+static struct device *video_device = NULL;
+
+// Serializes drawing and buffer swaps between every open file. Command
+// parsing happens on each file's private context, outside of the lock.
+static DEFINE_MUTEX(video_mutex);
+
+// Display statistics, read from /sys/class/video/video/stats
+static DEVICE_ATTR_RO(stats);
+
+static struct file_operations fops = {
+	.owner = THIS_MODULE,
+	.read = device_read,
+	.write = device_write,
+	.open = device_open,
+	.release = device_release
+};
+
+/* Code to initialize the video driver */
+static int __init start_video(void)
+{
+	int err = 0;
+	int resolution = 0;
+	int c_resolution = 0;
+	// initialize the dev_t, cdev, and class data structures
+	/* Get a device number. Get one minor number (0) */
+	if ((err = alloc_chrdev_region (&dev_no, 0, 1, DEVICE_NAME)) < 0) {
+		printk (KERN_ERR "video: alloc_chrdev_region() failed with return value %d\n", err);
+		return err;
+	}
+
+	// Allocate and initialize the character device
+	cdev = cdev_alloc (); 
+	cdev->ops = &fops; 
+	cdev->owner = THIS_MODULE; 
+   
+	// Add the character device to the kernel
+	if ((err = cdev_add (cdev, dev_no, 1)) < 0) {
+		printk (KERN_ERR "video: cdev_add() failed with return value %d\n", err);
+		return err;
+	}
+	
+	class = class_create (THIS_MODULE, DEVICE_NAME);
+	video_device = device_create (class, NULL, dev_no, NULL, DEVICE_NAME );
+	if ((err = device_create_file (video_device, &dev_attr_stats)) < 0)
+		printk (KERN_ERR "video: device_create_file() failed with return value %d\n", err);
+
+// generate a virtual address for the FPGA lightweight bridge
+        LW_virtual = ioremap_nocache (0xFF200000, 0x00005000);
+        if (LW_virtual == 0)
+                printk (KERN_ERR "Error: ioremap_nocache returned NULL\n");
+
+// Create virtual memory access to the pixel buffer controller
+        pixel_ctrl_ptr = (unsigned int *) (LW_virtual + 0x00003020);
+
+// Create virtual memory access to the character buffer controller
+		char_ctrl_ptr = (unsigned int*) (LW_virtual + CHAR_BUF_CTRL_BASE);
+
+// Create virtual memory access to the pixel buffer
+        pixel_buffer = (short int *) ioremap_nocache (0xC8000000, 0x0003FFFF);
+        if (pixel_buffer == 0)
+                printk (KERN_ERR "Error: ioremap_nocache returned NULL\n");
+
+// Create virtual memory access to the character buffer
+        char_buffer = (char *) ioremap_nocache (0xC9000000, 0x00002FFF);
+        if (char_buffer == 0)
+                printk (KERN_ERR "Error: ioremap_nocache returned NULL\n");
+
+#ifndef DOUBLE_BUFFER
+		*(pixel_ctrl_ptr + BACK_BUFFER_REGISTER) = *(pixel_ctrl_ptr + BUFFER_REGISTER);
+		pixel_back_buffer = pixel_buffer;
+#else
+		pixel_back_buffer = (short int *) ioremap_nocache( SDRAM_BASE, FPGA_ONCHIP_SPAN );
+		if (pixel_back_buffer == 0)
+		{
+                printk (KERN_ERR "SDRAM Error: ioremap_nocache returned NULL\n");
+				//*(pixel_ctrl_ptr + BACK_BUFFER_REGISTER) = *(pixel_ctrl_ptr + BUFFER_REGISTER);
+		}
+	
+		*(pixel_ctrl_ptr + BACK_BUFFER_REGISTER) = SDRAM_BASE;
+#endif
+		
+		resolution  = *(pixel_ctrl_ptr + RESOLUTION_REGISTER);
+		c_resolution = *(char_ctrl_ptr + RESOLUTION_REGISTER);
+		hw_backend.resolution_x = resolution & 0xFFFF;
+		hw_backend.resolution_y = (resolution >> 16) & 0xFFFF;
+		hw_backend.c_resolution_x = c_resolution & 0xFFFF;
+		hw_backend.c_resolution_y = (c_resolution >> 16) & 0xFFFF;
+		hw_backend.pixel_row_stride = PIXEL_ROW_STRIDE;
+		hw_backend.char_row_stride = CHAR_ROW_STRIDE;
+		hw_backend.back_buffer = pixel_buffer;
+		hw_backend.front_buffer = pixel_back_buffer;
+		label_buffers(&hw_backend);
+		hw_backend.char_buffer = char_buffer;
+		hw_backend.swap = hw_swap;
+		video_set_backend(&hw_backend);
+
+/* Erase the pixel buffer */
+        clear_screen ( );
+        return 0;
+}
+
+// Requests a buffer swap from the pixel buffer controller, waits for
+// it to happen on the next vsync and starts drawing into the other buffer.
+void hw_swap(video_backend* backend)
+{
+	*(pixel_ctrl_ptr + BUFFER_REGISTER) = 0x1;
+	
+	while(*(pixel_ctrl_ptr + STATUS_REGISTER) & 1)
+	{
+		// Block client, but let other tasks run while we wait for vsync
+		cond_resched();
+	}
+
+	label_buffers(backend);
+	
+	return;
+}
+
+// Points back_buffer at whichever buffer the controller is not showing,
+// going by the front buffer address in BUFFER_REGISTER.
+void label_buffers(video_backend* backend)
+{
+#ifdef DOUBLE_BUFFER
+	if(*(pixel_ctrl_ptr + BUFFER_REGISTER) == SDRAM_BASE)
+	{
+		backend->back_buffer = pixel_buffer;
+		backend->front_buffer = pixel_back_buffer;
+	}
+	else
+	{
+		backend->back_buffer = pixel_back_buffer;
+		backend->front_buffer = pixel_buffer;
+	}
+#endif
+}
+
+int video_lock(void)
+{
+	if (mutex_lock_interruptible(&video_mutex))
+		return -ERESTARTSYS;
+	return 0;
+}
+
+void video_unlock(void)
+{
+	mutex_unlock(&video_mutex);
+}
+
+static ssize_t stats_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	int length = 0;
+
+	if (video_lock())
+		return -ERESTARTSYS;
+	length = video_format_stats(buf, PAGE_SIZE);
+	video_unlock();
+
+	return length;
+}
+
+static void __exit stop_video(void)
+{
+/* unmap the physical-to-virtual mappings */
+    iounmap (LW_virtual);
+    iounmap ((void *) pixel_buffer);
+	iounmap ((void *) char_buffer);
+#ifdef DOUBLE_BUFFER
+	iounmap ((void *) pixel_back_buffer);
+#endif
+
+	free_surfaces();
+
+/* Remove the device from the kernel */
+	device_remove_file (video_device, &dev_attr_stats);
+	device_destroy (class, dev_no);
+	cdev_del (cdev);
+	class_destroy (class);
+	unregister_chrdev_region (dev_no, 1);
+}
+// Every open file gets its own drawing context, so that several
+// producers can share the display without stepping on each other.
+static int device_open(struct inode *inode, struct file *file)
+{
+	video_context* ctx = kzalloc(sizeof(video_context), GFP_KERNEL);
+
+	if (ctx == NULL)
+		return -ENOMEM;
+
+	init_context(ctx);
+	mutex_init(&ctx->lock);
+	file->private_data = ctx;
+
+	return SUCCESS;
+}
+static int device_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+static ssize_t device_read(struct file *filp, char *buffer,
+                           size_t length, loff_t *offset)
+{
+	video_context* ctx = filp->private_data;
+	char* msg = ctx->msg;
+	size_t bytes;
+
+	if (mutex_lock_interruptible(&ctx->lock))
+		return -ERESTARTSYS;
+	get_screen_specs(msg);
+	bytes = strlen (msg) - (*offset);	// how many bytes not yet sent?
+	bytes = bytes > length ? length : bytes;	// too much to send all at once?
+	
+	if (bytes)
+		if (copy_to_user (buffer, &msg[*offset], bytes) != 0)
+			printk (KERN_ERR "Error: copy_to_user unsuccessful");
+	*offset = bytes;	// keep track of number of bytes sent to the user
+	mutex_unlock(&ctx->lock);
+	
+	return bytes;
+}
+
+static ssize_t device_write(struct file *filp, const char
+                            *buffer, size_t length, loff_t *offset)
+{
+	video_context* ctx = filp->private_data;
+	char* msg = ctx->msg;
+	size_t bytes = length;
+	int err = 0;
+	
+	if (bytes == 0)
+		return 0;
+	if (bytes > MAX_SIZE - 1)
+		bytes = MAX_SIZE - 1;
+	
+	// Held until the command has run, as it is parsed in place in msg
+	if (mutex_lock_interruptible(&ctx->lock))
+		return -ERESTARTSYS;
+	if (copy_from_user (msg, buffer, bytes) != 0)
+	{
+		mutex_unlock(&ctx->lock);
+		return -EFAULT;
+	}
+	msg[bytes] = '\0';
+	if (msg[bytes-1] == '\n')
+		msg[bytes-1] = '\0';
+	
+	err = video_process_command(ctx);
+	mutex_unlock(&ctx->lock);
+	if (err != 0)
+		return err;
+
+	return bytes;
+}
+
+MODULE_LICENSE("GPL");
+module_init (start_video);
+module_exit (stop_video);
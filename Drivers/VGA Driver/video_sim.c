@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "video_soft.h"
+
+/* Runs video driver commands through the drawing core on the in-memory
+ * frame buffer, without the DE1-SoC. Commands are read one per line, in
+ * the same format /dev/video accepts.
+ *
+ * Usage: ./video_sim [-o frame_prefix] [-t] [-s] [-r repeat] [command_file]
+ *   -o  dump every frame shown by "sync" as <frame_prefix>NNNNN.ppm
+ *   -t  print the character buffer when done
+ *   -s  print the driver statistics when done
+ *   -r  run the command file repeat times (for benchmarking)
+ */
+
+static soft_framebuffer fb;
+static video_context ctx;
+
+// Single threaded: there is nothing to serialize.
+int video_lock(void)
+{
+	return 0;
+}
+
+void video_unlock(void)
+{
+}
+
+double elapsed_seconds(struct timespec* start, struct timespec* end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+	FILE* input = stdin;
+	char* frame_prefix = NULL;
+	char frame_path[256];
+	char stats_text[MAX_STATS_SIZE];
+	char* line = NULL;
+	size_t line_size = 0;
+	ssize_t length = 0;
+	unsigned long commands = 0;
+	unsigned long dumped = 0;
+	int print_text = 0;
+	int print_stats = 0;
+	int repeat = 1;
+	int option = 0;
+	int i = 0;
+	double seconds = 0;
+	struct timespec start, end;
+
+	while ((option = getopt(argc, argv, "o:tsr:")) != -1)
+	{
+		switch (option)
+		{
+			case 'o':
+				frame_prefix = optarg;
+			break;
+			case 't':
+				print_text = 1;
+			break;
+			case 's':
+				print_stats = 1;
+			break;
+			case 'r':
+				repeat = atoi(optarg);
+			break;
+			default:
+				fprintf(stderr, "Usage: %s [-o frame_prefix] [-t] [-s] [-r repeat] [command_file]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind < argc && (input = fopen(argv[optind], "r")) == NULL)
+	{
+		fprintf(stderr, "Could not open %s\n", argv[optind]);
+		return 1;
+	}
+	if (repeat > 1 && input == stdin)
+	{
+		fprintf(stderr, "-r needs a command file\n");
+		return 1;
+	}
+
+	soft_init(&fb);
+	video_set_backend(&fb.backend);
+	init_context(&ctx);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < repeat; i++)
+	{
+		rewind(input);
+		while ((length = getline(&line, &line_size, input)) > 0)
+		{
+			if (line[length-1] == '\n')
+				line[--length] = '\0';
+			if (length == 0)
+				continue;
+			if (length > MAX_SIZE - 1)
+				line[MAX_SIZE - 1] = '\0';
+
+			strcpy(ctx.msg, line);
+			video_process_command(&ctx);
+			commands++;
+
+			if (frame_prefix != NULL && !strcmp(line, "sync"))
+			{
+				snprintf(frame_path, sizeof(frame_path), "%s%05lu.ppm", frame_prefix, dumped++);
+				if (soft_dump_ppm(&fb, frame_path))
+					fprintf(stderr, "Could not write %s\n", frame_path);
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	seconds = elapsed_seconds(&start, &end);
+	fprintf(stderr, "%lu commands, %lu frames in %.3f s (%.0f commands/s)\n",
+	        commands, fb.frames, seconds, seconds > 0 ? commands / seconds : 0);
+
+	if (print_text)
+		soft_dump_text(&fb, stdout);
+	if (print_stats)
+	{
+		video_format_stats(stats_text, sizeof(stats_text));
+		fputs(stats_text, stdout);
+	}
+
+	free(line);
+	free_surfaces();
+	if (input != stdin)
+		fclose(input);
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+#include "video_soft.h"
+
+/* Software backend for the drawing core. Lets the rasterizer and the
+ * command parser run on any Linux box, with frames dumped as PPM images.
+ */
+
+void soft_init(soft_framebuffer* fb)
+{
+	memset(fb, 0, sizeof(soft_framebuffer));
+	memset(fb->characters, ' ', sizeof(fb->characters));
+
+	fb->backend.resolution_x = SOFT_RESOLUTION_X;
+	fb->backend.resolution_y = SOFT_RESOLUTION_Y;
+	fb->backend.c_resolution_x = SOFT_C_RESOLUTION_X;
+	fb->backend.c_resolution_y = SOFT_C_RESOLUTION_Y;
+	fb->backend.pixel_row_stride = SOFT_RESOLUTION_X;
+	fb->backend.char_row_stride = SOFT_C_RESOLUTION_X;
+	fb->backend.back_buffer = fb->buffers[0];
+	fb->backend.front_buffer = fb->buffers[1];
+	fb->backend.char_buffer = fb->characters;
+	fb->backend.swap = soft_swap;
+}
+
+// There is no vsync to wait for: the buffers are exchanged immediately.
+void soft_swap(video_backend* backend)
+{
+	soft_framebuffer* fb = (soft_framebuffer*) backend;
+	short int* shown = backend->back_buffer;
+
+	backend->back_buffer = backend->front_buffer;
+	backend->front_buffer = shown;
+	fb->frames++;
+}
+
+// Writes the buffer on screen as a binary PPM, expanding RGB565 to 8 bits
+// per channel. Returns 0 on success, -1 if the file could not be written.
+int soft_dump_ppm(soft_framebuffer* fb, const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	unsigned char row[SOFT_RESOLUTION_X * 3];
+	unsigned short pixel = 0;
+	int x = 0;
+	int y = 0;
+
+	if (file == NULL)
+		return -1;
+
+	fprintf(file, "P6\n%d %d\n255\n", SOFT_RESOLUTION_X, SOFT_RESOLUTION_Y);
+	for (y = 0; y < SOFT_RESOLUTION_Y; y++)
+	{
+		for (x = 0; x < SOFT_RESOLUTION_X; x++)
+		{
+			pixel = fb->backend.front_buffer[y * SOFT_RESOLUTION_X + x];
+			row[x*3] = ((pixel >> 11) & 0x1F) * 255 / 0x1F;
+			row[x*3 + 1] = ((pixel >> 5) & 0x3F) * 255 / 0x3F;
+			row[x*3 + 2] = (pixel & 0x1F) * 255 / 0x1F;
+		}
+		fwrite(row, 1, sizeof(row), file);
+	}
+
+	return fclose(file) == 0 ? 0 : -1;
+}
+
+// Prints the character buffer, one screen row per line.
+void soft_dump_text(soft_framebuffer* fb, FILE* out)
+{
+	int y = 0;
+
+	for (y = 0; y < SOFT_C_RESOLUTION_Y; y++)
+		fprintf(out, "%.*s\n", SOFT_C_RESOLUTION_X, &fb->characters[y * SOFT_C_RESOLUTION_X]);
+}
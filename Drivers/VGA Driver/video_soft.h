@@ -0,0 +1,27 @@
+#ifndef _VIDEO_SOFT_
+#define _VIDEO_SOFT_
+
+#include <stdio.h>
+#include "video_core.h"
+
+#define SOFT_RESOLUTION_X 320
+#define SOFT_RESOLUTION_Y 240
+#define SOFT_C_RESOLUTION_X 80
+#define SOFT_C_RESOLUTION_Y 60
+
+// In-memory, double-buffered 320x240 RGB565 frame buffer with the same
+// behaviour as the VGA pixel and character buffers.
+typedef struct soft_framebuffer
+{
+	video_backend backend; // must stay first, see soft_swap
+	short int buffers[2][SOFT_RESOLUTION_X * SOFT_RESOLUTION_Y];
+	char characters[SOFT_C_RESOLUTION_X * SOFT_C_RESOLUTION_Y];
+	unsigned long frames; // number of completed swaps
+} soft_framebuffer;
+
+void soft_init(soft_framebuffer*);
+void soft_swap(video_backend*);
+int soft_dump_ppm(soft_framebuffer*, const char*);
+void soft_dump_text(soft_framebuffer*, FILE*);
+
+#endif
@@ -7,36 +7,50 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <linux/input.h>
-#include <sys/mman.h>
 #include <math.h>
 #include <signal.h>
 #include <pthread.h>
-#include "address_map_arm.h"
 #include "aux_functions.h"
+#include "synth.h"
+#include "note_queue.h"
+#include "recording.h"
+#include "midi.h"
+#include "wav.h"
+#include "scope.h"
 
 //#define DYNAMIC_VOLUME
 
 // Global variables
-volatile unsigned int* Audio_Base = NULL;
-volatile void* LW_Bridge = NULL;
-int fd = -1; // used to open /dev/mem for access to physical addresses
-int chord_vol_mask[FREQS_IN_MIDDLE_C_SCALE] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-int note_faders[FREQS_IN_MIDDLE_C_SCALE] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-int video_buffer[VIDEO_X_RES];
-char flag_press_release = 0;
+note_queue note_events;                                   // keyboard thread -> audio thread
+int octave_shift = 0;                                     // octaves above/below middle C
+int held_notes[FREQS_IN_MIDDLE_C_SCALE];                  // note each piano key started, for its release
 int video_FD;                                             // video file descriptor
 int key_FD;                                               // key file descriptor
 int ledr_FD;                                              // ledr file descriptor
 int hex_FD;                                               // hex file descriptor
 int stopwatch_FD;                                         // hex file descriptor
+int audio_FD;                                             // audio file descriptor
 
 char command[COMMAND_STR_SIZE];
-int video_i = 0;										  // Iterator for video_buffer
-pthread_mutex_t mutex_chord_vol, mutex_video_buffer;
 
-recording_node* first = NULL;
-recording_node* next = NULL;
-recording_node* current = NULL;
+// Scope frames, audio thread -> video thread. The decimation state is
+// owned by the audio thread.
+scope_buffer scope;
+int scope_column = 0;                                     // column being filled in the back frame
+int scope_count = 0;                                      // samples already in that column
+
+// Record and playback. The main thread owns song while not playing; during
+// playback only the audio thread reads it.
+recording song;
+char* recording_path = NULL;                              // optional file the song is loaded from and saved to
+char* keyboard_path = NULL;
+char* midi_path = NULL;                                   // raw MIDI bytes: file, FIFO or /dev/midi*
+int autoplay = 0;                                         // play the loaded song at start-up
+char* wav_path = NULL;                                    // render the song offline to this file and exit
+int recording_active = 0;
+long long record_start_us = 0;
+atomic_int playback_command = PLAYBACK_NONE;              // main thread -> audio thread
+atomic_int playback_running = 0;                          // cleared by the audio thread when playback ends
 
 volatile sig_atomic_t stop = 0;
 void catchSIGINT(int signum){
@@ -47,13 +61,28 @@ int main (int argc, char** argv)
 {
 	int err = 0;
 	int kbd_fd = -1;
+	int midi_fd = -1;
+	midi_parser midi_in;
 	int recording = 0;
 	int playing = 0;
+	int was_recording = 0;
+	int was_playing = 0;
 	struct input_event kbd_event;
 	pthread_t tid_audio, tid_video;
 
-	memset(video_buffer,0,(VIDEO_X_RES * sizeof(int)));
+	scope_buffer_init(&scope);
 	
+	err = parse_cmd_line(argc, argv);
+	if (err != SUCCESS)
+	{
+		print_error(err);
+		return err;
+	}
+
+	// The offline render needs none of the board's devices
+	if (wav_path != NULL)
+		return render_to_wav(recording_path, wav_path);
+
 	// Catch SIGINT from ^C
 	signal(SIGINT, catchSIGINT);
 
@@ -86,26 +115,41 @@ int main (int argc, char** argv)
 		printf("Error opening /dev/stopwatch: %s\n", strerror(errno));
 		return -1;
 	}
-										  
-	if(map_virtual() != 0)
+
+	// Open the character device driver
+	if ((audio_FD = open("/dev/audio", O_WRONLY)) == -1){
+		printf("Error opening /dev/audio: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (recording_init(&song) != 0)
 	{
-		printf("Fatal error mapping virtual addresses.\n"
-		       "Aborting...\n");
+		printf("Out of memory for the recording.\n");
 		return -1;
 	}
+	if (recording_path != NULL && access(recording_path, F_OK) == 0 &&
+	    load_song(recording_path) != 0)
+		printf("Could not load the recording %s, starting empty.\n", recording_path);
 	
-	err = parse_cmd_line(argc, argv, chord_vol_mask);
-	if (err != SUCCESS)
+	if (keyboard_path != NULL)
 	{
-		print_error(err);
-		return err;
+		kbd_fd = init_keyboard(keyboard_path);
+		if(kbd_fd == ERR_INVALID_KBD)
+		{
+			print_error(ERR_INVALID_KBD);
+			return ERR_INVALID_KBD;
+		}
 	}
-	
-	kbd_fd = init_keyboard(argv[PARAM_KEYBOARD]);
-	if(kbd_fd == ERR_INVALID_KBD)
+
+	if (midi_path != NULL)
 	{
-		print_error(ERR_INVALID_KBD);
-		return ERR_INVALID_KBD;
+		midi_fd = init_midi_input(midi_path);
+		if(midi_fd == ERR_INVALID_MIDI)
+		{
+			print_error(ERR_INVALID_MIDI);
+			return ERR_INVALID_MIDI;
+		}
+		midi_parser_init(&midi_in);
 	}
 	
 	// Spawn the audio thread.
@@ -123,46 +167,53 @@ int main (int argc, char** argv)
 	}
 
 	set_processor_affinity(0);
+
+	if (autoplay && song.n_events > 0)
+	{
+		playing = 1;
+		control_ledr_hex(PLAY_KEY, recording, playing);
+		start_playback();
+	}
 	
 	while(!stop)
 	{
 		int key = 0;
-		long total_play_time = 0;
+		was_recording = recording;
+		was_playing = playing;
 		key = read_key();
 		set_rec_play(key, &recording, &playing);
 		control_ledr_hex(key, recording, playing);
+		recording_active = recording;
 
-		if(!playing)
-			kbd_event = read_keyboard(kbd_fd);
-			
-		else
-		{
-			total_play_time = time_in_hundreths();
-			if(total_play_time <= current->ev_time)
-			{
-				kbd_event = current->ev;
-				current = current->next;
-				if (current == NULL)
-				{
-					playing = 0;
-					current = first;
-					write (stopwatch_FD, STOPWATCH_STOP_MSG , STOPWATCH_STOP_MSG_LEN);
-					write (stopwatch_FD, STOPWATCH_NODISP_MSG, STOPWATCH_NODISP_MSG_LEN);
-					write (ledr_FD, LEDR_CLEAR_MSG , LEDR_MSG_LEN);
-				}
-			}
+		if (was_recording && !recording && recording_path != NULL &&
+		    save_song(recording_path) != 0)
+			printf("Could not save the recording to %s\n", recording_path);
 
+		if (playing && !was_playing)
+			start_playback();
+		else if (!playing && was_playing)
+			stop_playback();
+		else if (playing && !atomic_load(&playback_running))
+		{
+			// The audio thread played the last event
+			playing = 0;
+			write (stopwatch_FD, STOPWATCH_STOP_MSG , STOPWATCH_STOP_MSG_LEN);
+			write (stopwatch_FD, STOPWATCH_NODISP_MSG, STOPWATCH_NODISP_MSG_LEN);
+			write (ledr_FD, LEDR_CLEAR_MSG , LEDR_MSG_LEN);
 		}
 
-		if (kbd_event.code > 0)
+		if (kbd_fd != -1)
 		{
-			if(recording && kbd_event.code != 0 &&
-				(kbd_event.value == KEY_PRESSED || kbd_event.value == KEY_RELEASED))
-				record_note(kbd_event);
-
-			update_notes_volume(kbd_event);
-			kbd_event.code=-1;
+			kbd_event = read_keyboard(kbd_fd);
+			if (kbd_event.code > 0)
+			{
+				update_notes_volume(kbd_event);
+				kbd_event.code=-1;
+			}
 		}
+
+		if (midi_fd != -1)
+			read_midi_input(midi_fd, &midi_in);
 	}
 
 
@@ -180,71 +231,148 @@ int main (int argc, char** argv)
 	write (stopwatch_FD, STOPWATCH_STOP_MSG , STOPWATCH_STOP_MSG_LEN);
 	write (stopwatch_FD, STOPWATCH_NODISP_MSG, STOPWATCH_NODISP_MSG_LEN);
 
-	delete_recording();
+	recording_free(&song);
 
-	close (kbd_fd);
+	if (kbd_fd != -1)
+		close (kbd_fd);
+	if (midi_fd != -1)
+		close (midi_fd);
 	close (video_FD);
 	close (key_FD);
 	close (hex_FD);
 	close (ledr_FD);
 	close (stopwatch_FD);
-	unmap_virtual();
-	close_physical(fd);
+	close (audio_FD);
 	
 	return SUCCESS;
 }
 
-void delete_recording(void)
+// Clears the song and starts the recording clock
+void start_recording(void)
 {
-	current = first;
+	recording_clear(&song);
+	record_start_us = monotonic_us();
+}
 
-	while(current != NULL)
-	{
-		next = current->next;
-		free(current);
-		current = next;
-	}
+void record_note(int note, int state, int velocity)
+{
+	if (recording_append(&song, monotonic_us() - record_start_us, note, state, velocity) != 0)
+		fprintf(stderr, "Recording full, note not recorded.\n");
+}
 
-	first = NULL;
-	current = NULL;
-	next = NULL;
+// Files ending in .mid or .midi are Standard MIDI Files, anything else
+// uses the recording's own format.
+int load_song(char* path)
+{
+	return is_midi_file(path) ? midi_load(&song, path) : recording_load(&song, path);
 }
 
-void record_note(struct input_event kbd_event)
+int save_song(char* path)
 {
-	next = (recording_node*) malloc(sizeof(recording_node));
-	
-	if(first == NULL)
+	return is_midi_file(path) ? midi_save(&song, path) : recording_save(&song, path);
+}
+
+// Plays the song through the synth as fast as the CPU allows, writes the
+// output to a WAV file and reports how much faster than real time it ran.
+// The checksum of the samples makes a run comparable with a golden one.
+int render_to_wav(char* song_path, char* path)
+{
+	int block[SYNTH_BLOCK_SIZE];
+	int play_index = 0;
+	long long play_position = 0;
+	long long n_samples = 0;
+	long long tail_samples = 0;
+	long long start_us = 0;
+	long long elapsed_us = 0;
+	unsigned int checksum = FNV_OFFSET_BASIS;
+	int playing_song = 1;
+	int err = SUCCESS;
+	int i = 0;
+	wav_writer wav;
+	synth piano;
+
+	if (recording_init(&song) != 0)
 	{
-		first = next;
-		current = first;
-		current->next = NULL;
+		printf("Out of memory for the recording.\n");
+		return -1;
 	}
-	else
+	if (load_song(song_path) != 0)
+	{
+		printf("Could not load the recording %s\n", song_path);
+		recording_free(&song);
+		return -1;
+	}
+	if (wav_open(&wav, path, SAMPLE_RATE) != 0)
+	{
+		printf("Could not create %s\n", path);
+		recording_free(&song);
+		return -1;
+	}
+
+	synth_init(&piano, SAMPLE_RATE);
+	start_us = monotonic_us();
+
+	// Render the song, then let the last notes ring out
+	while((playing_song || synth_active_voices(&piano) > 0) &&
+	      tail_samples < RENDER_MAX_TAIL_S * SAMPLE_RATE)
+	{
+		if(playing_song && song.n_events > 0)
+			playing_song = render_with_playback(&piano, block, &play_index, &play_position);
+		else
+		{
+			playing_song = 0;
+			synth_render(&piano, block, SYNTH_BLOCK_SIZE);
+			tail_samples += SYNTH_BLOCK_SIZE;
+		}
+
+		for(i = 0; i < SYNTH_BLOCK_SIZE; i++)
+			checksum = (checksum ^ (unsigned int) block[i]) * FNV_PRIME;
+
+		if(wav_write(&wav, block, SYNTH_BLOCK_SIZE) != 0)
+		{
+			err = -1;
+			break;
+		}
+		n_samples += SYNTH_BLOCK_SIZE;
+	}
+
+	elapsed_us = monotonic_us() - start_us;
+	if(wav_close(&wav) != 0)
+		err = -1;
+	recording_free(&song);
+
+	if(err != SUCCESS)
 	{
-		current->next = next;
-		current = current->next;
-		current->next = NULL;
+		printf("Error writing %s\n", path);
+		return err;
 	}
 
-	current->ev = kbd_event;
-	current->ev_time = time_in_hundreths();
+	if(elapsed_us < 1)
+		elapsed_us = 1;
+	printf("Rendered %d events, %.2f s of audio in %.3f s: %.1fx real time, %.1f ns per sample.\n"
+	       "Checksum %08x\n",
+	       play_index, (double) n_samples / SAMPLE_RATE, elapsed_us / 1e6,
+	       (double) n_samples * 1000000 / SAMPLE_RATE / elapsed_us, elapsed_us * 1000.0 / n_samples,
+	       checksum);
+	return SUCCESS;
 }
 
-long time_in_hundreths()
+// Playback runs in the audio thread, which schedules each recorded event
+// at its exact sample.
+void start_playback(void)
 {
-	char stopwatch_buffer[STOPWATCH_BYTES+1];
-	const long char_to_num_offset = 48;
-	read_from_driver_FD(stopwatch_FD, stopwatch_buffer, STOPWATCH_BYTES);
-	
-	return (((stopwatch_buffer[0] - char_to_num_offset) * 10 + (stopwatch_buffer[1] - char_to_num_offset)) * 60 * 100) +
-	       (((stopwatch_buffer[3] - char_to_num_offset) * 10 + (stopwatch_buffer[4] - char_to_num_offset)) * 100) +
-	       (((stopwatch_buffer[6] - char_to_num_offset) * 10 + (stopwatch_buffer[7] - char_to_num_offset)));
+	atomic_store(&playback_running, 1);
+	atomic_store(&playback_command, PLAYBACK_START);
+}
+
+void stop_playback(void)
+{
+	atomic_store(&playback_command, PLAYBACK_STOP);
 }
 
 void set_rec_play(int key, int* recording, int* playing)
 {
-	if(*recording && time_in_hundreths() == 0)
+	if(*recording && monotonic_us() - record_start_us >= MAX_REC_TIME_US)
 	{
 		*recording = 0;
 		write (ledr_FD, LEDR_CLEAR_MSG , LEDR_MSG_LEN);
@@ -280,7 +408,7 @@ void set_rec_play(int key, int* recording, int* playing)
 				return;
 			}
 
-			if(!*playing && first != NULL)
+			if(!*playing && song.n_events > 0)
 				*playing = 1;
 			else
 				*playing = 0;
@@ -305,7 +433,7 @@ void control_ledr_hex(int key, int recording, int playing)
 				write (stopwatch_FD, stopwatch_buffer, STOPWATCH_BYTES);
 				write (stopwatch_FD, STOPWATCH_DISP_MSG, STOPWATCH_DISP_MSG_LEN);
 				write (stopwatch_FD, STOPWATCH_RUN_MSG, STOPWATCH_RUN_MSG_LEN);
-				delete_recording();
+				start_recording();
 			}
 			else if (!playing)
 			{
@@ -317,7 +445,6 @@ void control_ledr_hex(int key, int recording, int playing)
 		case PLAY_KEY:
 			if(!recording)
 			{
-				current = first;
 				write (ledr_FD, LEDR_PLAY_MSG , LEDR_MSG_LEN);
 				write (stopwatch_FD, stopwatch_buffer, STOPWATCH_BYTES);
 				write (stopwatch_FD, STOPWATCH_DISP_MSG, STOPWATCH_DISP_MSG_LEN);
@@ -351,103 +478,181 @@ int read_key(void)
 void* video_thread(void* none)
 {
 	set_processor_affinity(0);
-	char video_cmd_str[COMMAND_STR_SIZE] = "";
+	char video_cmd_str[PEAKS_CMD_STR_SIZE] = "";
+	scope_frame* frame = NULL;
+	scope_frame* newest = NULL;
 
 	while(1)
 	{
 		pthread_testcancel();
 		int i = 0;
-		int sample_i = 0;
-		int sample_next = 0;
+		int length = 0;
 		
 		write (video_FD, "sync", COMMAND_STR_SIZE);
 		write (video_FD, "clear", COMMAND_STR_SIZE);
+
+		// Keep redrawing the last frame until the audio thread
+		// publishes a newer one.
+		if((newest = scope_grab(&scope)) != NULL)
+			frame = newest;
+		if(frame == NULL)
+			continue;
 		
-		for(i = 0; i < VIDEO_X_RES - 1; i++)
-		{
-			pthread_mutex_lock(&mutex_video_buffer);
-			sample_i = (int)((float)video_buffer[i]/((float)MAX_VOL) * (VIDEO_Y_RES - 1)/2.0 + VIDEO_Y_RES/2.0);
-			sample_next = (int)((float)video_buffer[i+1]/((float)MAX_VOL) * (VIDEO_Y_RES - 1)/2.0 + VIDEO_Y_RES/2.0);
-			pthread_mutex_unlock(&mutex_video_buffer);
-			
-			sprintf(video_cmd_str,"line %i,%i %i,%i %04x", i, sample_i, i + 1, sample_next, GREEN);
-			write(video_FD, video_cmd_str, COMMAND_STR_SIZE);
-		}
-		
+		// The whole trace is one "peaks" command: each column spans the
+		// extremes of the samples behind it.
+		length = sprintf(video_cmd_str, "peaks 0,1 %04x", GREEN);
+		for(i = 0; i < SCOPE_COLUMNS; i++)
+			length += sprintf(video_cmd_str + length, " %i %i",
+				scope_y(frame->min[i]), scope_y(frame->max[i]));
+
+		write(video_FD, video_cmd_str, length);
 	}
 	
 }
 
+// Screen row of a sample: full scale spans the screen height. Shifting
+// by 32 divides by 2*MAX_VOL without any float math.
+int scope_y(int sample)
+{
+	return VIDEO_Y_RES/2 + (int)(((long long) sample * (VIDEO_Y_RES - 1)) >> 32);
+}
+
 void* audio_thread(void* none)
 {
 	set_processor_affinity(1);
 
-	int sample = 0;
-	int f = 0;
-	int sample_i[FREQS_IN_MIDDLE_C_SCALE] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-	float frequencies[FREQS_IN_MIDDLE_C_SCALE] = {261.626, 277.183, 293.665, 
-												  311.127, 329.628, 349.228, 
-												  369.994, 391.995, 415.305, 
-												  440.000, 466.164, 493.883, 523.251};
+	int block[SYNTH_BLOCK_SIZE];
+	int playing_song = 0;
+	int play_index = 0;                                   // next recorded event to play
+	long long play_position = 0;                          // samples since playback started
+	synth piano;
+
+	synth_init(&piano, SAMPLE_RATE);
 
 	while(1)
 	{
 		pthread_testcancel();
-		
-		for(f = 0; f < FREQS_IN_MIDDLE_C_SCALE; f++)
+
+		// Key presses and releases only take effect at block
+		// boundaries, and nothing here ever waits on the keyboard.
+		drain_note_events(&piano);
+
+		switch(atomic_exchange(&playback_command, PLAYBACK_NONE))
 		{
-			pthread_mutex_lock(&mutex_chord_vol);
+			case PLAYBACK_START:
+				playing_song = 1;
+				play_index = 0;
+				play_position = 0;
+			break;
+			case PLAYBACK_STOP:
+				playing_song = 0;
+				synth_all_notes_off(&piano);
+				atomic_store(&playback_running, 0);
+			break;
+		}
 
-			note_release_decay(f);
-			sample += get_next_sample_for_frequency(frequencies[f], SAMPLE_RATE, sample_i[f], chord_vol_mask[f]);
-			note_decay(f);
-		
-			
-			if(chord_vol_mask[f] != 0)
-				sample_i[f]++;
-			else
-				sample_i[f] = 0;			
-			pthread_mutex_unlock(&mutex_chord_vol);
+		if(playing_song)
+			playing_song = render_with_playback(&piano, block, &play_index, &play_position);
+		else
+			synth_render(&piano, block, SYNTH_BLOCK_SIZE);
+
+		capture_block(block, SYNTH_BLOCK_SIZE);
+		output_block(block, SYNTH_BLOCK_SIZE);
+	}
+}
+
+// Renders a block, starting each recorded event that falls inside it at
+// its own sample: the block is rendered in pieces between events.
+// Returns 0 once the last event has been played.
+int render_with_playback(synth* s, int block[], int* play_index, long long* play_position)
+{
+	recorded_event* ev = NULL;
+	note_event note;
+	long long event_sample = 0;
+	int offset = 0;
+
+	while(*play_index < song.n_events)
+	{
+		ev = recording_event(&song, *play_index);
+		event_sample = (long long) ev->time_us * SAMPLE_RATE / 1000000 - *play_position;
+		if(event_sample >= SYNTH_BLOCK_SIZE)
+			break;
+
+		if(event_sample > offset)
+		{
+			synth_render(s, block + offset, event_sample - offset);
+			offset = event_sample;
 		}
-	
-		output_sample(sample);
-		push_to_video_buffer(sample);
-		buffer_overflow_preventor();
-		sample = 0;
+
+		note.note = ev->note;
+		note.state = ev->state;
+		note.velocity = ev->velocity;
+		apply_note_event(s, note);
+		(*play_index)++;
 	}
+
+	if(offset < SYNTH_BLOCK_SIZE)
+		synth_render(s, block + offset, SYNTH_BLOCK_SIZE - offset);
+	*play_position += SYNTH_BLOCK_SIZE;
+
+	if(*play_index >= song.n_events)
+	{
+		atomic_store(&playback_running, 0);
+		return 0;
+	}
+
+	return 1;
 }
 
-void note_decay(int f)
+// Applies every queued key event to the synth
+void drain_note_events(synth* s)
 {
-	if (chord_vol_mask[f] > 20000)
-		chord_vol_mask[f] -= 20000;
-	else if (chord_vol_mask[f] > 0 && chord_vol_mask[f] <= 20000)
-		chord_vol_mask[f] -= 1;		
-	else
-		chord_vol_mask[f] = 0;
+	note_event ev;
+
+	while(note_queue_pop(&note_events, &ev))
+		apply_note_event(s, ev);
 }
 
-void push_to_video_buffer(int sample)
+void apply_note_event(synth* s, note_event ev)
 {
-	pthread_mutex_lock(&mutex_chord_vol);
-	int fading_now = find_abs_max(note_faders, FREQS_IN_MIDDLE_C_SCALE) == 0;
-	pthread_mutex_unlock(&mutex_chord_vol);
+	if(ev.state == KEY_PRESSED)
+		synth_note_on(s, ev.note, ev.velocity ? ev.velocity : NOTE_VELOCITY);
+	else
+		synth_note_off(s, ev.note);
+}
 
+// Decimates the output into the scope's back frame, SCOPE_DECIMATION
+// samples per column, keeping each column's minimum and maximum so peaks
+// between the kept points still show. Full frames are published with one
+// atomic exchange, so the audio thread never takes a lock for the scope.
+void capture_block(int block[], int n_samples)
+{
+	scope_frame* frame = scope_back(&scope);
+	int n = 0;
 
-	pthread_mutex_lock(&mutex_video_buffer);
-	if(flag_press_release && video_i < VIDEO_X_RES && fading_now)
-	{
-		video_buffer[video_i] = sample;
-		video_i++;
-	}
-	else if (video_i >= VIDEO_X_RES)
+	for(n = 0; n < n_samples; n++)
 	{
-		flag_press_release = 0;
-		video_i = 0;
+		if(scope_count == 0)
+		{
+			frame->min[scope_column] = block[n];
+			frame->max[scope_column] = block[n];
+		}
+		else if(block[n] < frame->min[scope_column])
+			frame->min[scope_column] = block[n];
+		else if(block[n] > frame->max[scope_column])
+			frame->max[scope_column] = block[n];
+
+		if(++scope_count < SCOPE_DECIMATION)
+			continue;
+		scope_count = 0;
+
+		if(++scope_column == SCOPE_COLUMNS)
+		{
+			scope_column = 0;
+			scope_publish(&scope);
+			frame = scope_back(&scope);
+		}
 	}
-	else if (fading_now)
-		video_i = 0;
-	pthread_mutex_unlock(&mutex_video_buffer);
 }
 
 int find_abs_max(int array[], int size)
@@ -462,104 +667,91 @@ int find_abs_max(int array[], int size)
 	return max;
 }
 
-// Implements an assympothic fade to
-// prevent changes in the DC level.
-void note_release_decay(int note)
+// Hands a key event to the audio thread. Never blocks: if the audio
+// thread has fallen 256 events behind, the event is dropped.
+void queue_note_event(int note, int state, int velocity)
 {
-	if(note_faders[note] > 0)
-	{
-		if (chord_vol_mask[note] > note_faders[note] && chord_vol_mask[note] < 2*note_faders[note])
-		{
-			note_faders[note] /= 2;
-			chord_vol_mask[note]-=note_faders[note];
-		}
-		else
-			chord_vol_mask[note]-=note_faders[note];
+	note_event ev = {note, state, velocity};
 
-		if(chord_vol_mask[note] <= 0)
-		{
-			note_faders[note] = 0;
-			chord_vol_mask[note] = 0;
-		}
-	}
+	if(!note_queue_push(&note_events, ev))
+		fprintf(stderr, "Note event queue full, dropping event.\n");
 }
 
-void bit_mask_volume_mask(int key, int state)
+// Sends a note from any input to the synth, and to the song while recording
+void play_note(int note, int state, int velocity)
 {
-	if(state == KEY_PRESSED)
-	{
-		chord_vol_mask[key] = state;
-		note_faders[key] = 0;
+	if(recording_active)
+		record_note(note, state, velocity);
+	queue_note_event(note, state, velocity);
+}
 
-		pthread_mutex_lock(&mutex_video_buffer);
-		flag_press_release = 1;
-		video_i = 0;
-		pthread_mutex_unlock(&mutex_video_buffer);
-	}
-	else
-	{
-		note_faders[key] = INIT_FADING_INTENSITY;
+// Turns a piano key (C to C2) into a MIDI note in the current octave.
+// The release always stops the note the press started, even if the
+// octave changed in between.
+void press_piano_key(int key, int state)
+{
+	if(state == KEY_PRESSED)
+		held_notes[key] = MIDDLE_C_NOTE + 12*octave_shift + key;
 
-		pthread_mutex_lock(&mutex_video_buffer);
-		flag_press_release = 1;
-		pthread_mutex_unlock(&mutex_video_buffer);
-	}
+	play_note(held_notes[key], state, NOTE_VELOCITY);
 }
 
 void process_individual_key(int key_code, int state)
 {
 	switch(key_code)
 	{
+		case OCTAVE_DOWN_KEY:
+			if(state == KEY_PRESSED && octave_shift > -MAX_OCTAVE_SHIFT)
+				octave_shift--;
+		break;
+		case OCTAVE_UP_KEY:
+			if(state == KEY_PRESSED && octave_shift < MAX_OCTAVE_SHIFT)
+				octave_shift++;
+		break;
 		case KEY_2:
-			bit_mask_volume_mask(CS_DB, state);
+			press_piano_key(CS_DB, state);
 		break;
 		case KEY_3:
-			bit_mask_volume_mask(DS_EB, state);
+			press_piano_key(DS_EB, state);
 		break;
 		case KEY_5:
-			bit_mask_volume_mask(FS_GB, state);
+			press_piano_key(FS_GB, state);
 		break;
 		case KEY_6:
-			bit_mask_volume_mask(GS_AB, state);
+			press_piano_key(GS_AB, state);
 		break;
 		case KEY_7:
-			bit_mask_volume_mask(AS_BB, state);
+			press_piano_key(AS_BB, state);
 		break;
 		case KEY_Q:
-			bit_mask_volume_mask(C, state);
+			press_piano_key(C, state);
 		break;
 		case KEY_W:
-			bit_mask_volume_mask(D, state);
+			press_piano_key(D, state);
 		break;
 		case KEY_E:
-			bit_mask_volume_mask(E, state);
+			press_piano_key(E, state);
 		break;
 		case KEY_R:
-			bit_mask_volume_mask(F, state);
+			press_piano_key(F, state);
 		break;
 		case KEY_T:
-			bit_mask_volume_mask(G, state);
+			press_piano_key(G, state);
 		break;
 		case KEY_Y:
-			bit_mask_volume_mask(A, state);
+			press_piano_key(A, state);
 		break;
 		case KEY_U:
-			bit_mask_volume_mask(B, state);
+			press_piano_key(B, state);
 		break;
 		case KEY_I:
-			bit_mask_volume_mask(C2, state);
+			press_piano_key(C2, state);
 		break;
 	}
 }
 
 void update_notes_volume(struct input_event kbd_event)
 {
-	int i = 0;
-#if defined(DYNAMIC_VOLUME)
-	int notes_in_chord = 0;
-#endif
-	
-	pthread_mutex_lock(&mutex_chord_vol);
 	switch(kbd_event.value)
 	{
 		case KEY_PRESSED:
@@ -569,45 +761,8 @@ void update_notes_volume(struct input_event kbd_event)
 			process_individual_key((int)kbd_event.code, KEY_RELEASED);
 		break;
 		default:
-			pthread_mutex_unlock(&mutex_chord_vol);
 			return;
 	}
-	
-	if((int)kbd_event.code == NO_KEY)
-	{
-		pthread_mutex_unlock(&mutex_chord_vol);
-		return;
-	}
-
-#if defined(DYNAMIC_VOLUME)
-	// 1) Create a binary mask for all the notes, allowing the
-	// program to count how many keys were pressed together
-	for (i = 0; i < FREQS_IN_MIDDLE_C_SCALE; i++)
-	{
-		// > 0 because bit masks are later replaced by scaling
-		// factors. See step 2) below.
-		if(chord_vol_mask[i] > 0)
-			notes_in_chord++;
-	}
-#endif
-	
-	// 2) Based on the bit mask '1s' count, scale the maximum
-	// volume and  set the volume  value in the mask array to 
-	// later scale samples
-	for (i = 0; i < FREQS_IN_MIDDLE_C_SCALE; i++)
-	{
-		if((chord_vol_mask[i] > 0) && (note_faders[i] == 0))
-			// Dividing MAX_VOL by 2 because our eardrums
-			// are bleeding here. Sorry...
-#if defined(DYNAMIC_VOLUME)
-			chord_vol_mask[i] = (MAX_VOL/2) / notes_in_chord;
-#else
-			chord_vol_mask[i] = (MAX_VOL/2) / 5; // Limit set to 5(10) because cheap keyboards
-                                                 // ghost before that many keys are pressed.
-#endif
-	}
-	pthread_mutex_unlock(&mutex_chord_vol);
-	
 }
 
 struct input_event read_keyboard(int fd)
@@ -637,6 +792,39 @@ int init_keyboard(char* dev_path)
 	return fd;
 }
 
+// Opens a raw MIDI byte source: a file, a FIFO or a /dev/midi* device
+int init_midi_input(char* path)
+{
+	int fd = -1;
+
+	if ((fd = open (path, O_RDONLY | O_NONBLOCK)) == -1)
+	{
+		printf ("Could not open %s\n", path);
+		return ERR_INVALID_MIDI;
+	}
+
+	return fd;
+}
+
+// Plays every note waiting on the MIDI input. Never reads more bytes than
+// the note queue has room for, so a file fed at full speed is throttled
+// by the audio thread instead of losing notes.
+void read_midi_input(int fd, midi_parser* parser)
+{
+	unsigned char bytes[MIDI_READ_BYTES];
+	unsigned int space = note_queue_space(&note_events);
+	int note = 0, state = 0, velocity = 0;
+	int n = 0, i = 0;
+
+	if (space == 0)
+		return;
+
+	n = read (fd, bytes, space < MIDI_READ_BYTES ? space : MIDI_READ_BYTES);
+	for (i = 0; i < n; i++)
+		if (midi_parse_byte(parser, bytes[i], &note, &state, &velocity))
+			play_note(note, state, velocity);
+}
+
 void print_error(int err)
 {
 	switch(err)
@@ -646,54 +834,90 @@ void print_error(int err)
 		break;
 		case ERR_INVALID_KBD:
 			printf("ERR: Invalid keyboard dev path.\n");
+		break;
+		case ERR_INVALID_MIDI:
+			printf("ERR: Invalid MIDI input path.\n");
 	}  
 
-	printf("Usage: ./part5 path_to_keyboard_dev.\n");
+	printf("Usage: ./Digital_piano [-m midi_input] [-r recording_file] [-p] [path_to_keyboard_dev] [recording_file].\n"
+	       "       ./Digital_piano -w out.wav -r recording_file\n"
+	       "  -m  raw MIDI bytes from a file, FIFO or /dev/midi*\n"
+	       "  -r  recording loaded at start-up and saved after recording, .mid or .midi for a MIDI file\n"
+	       "  -p  play the recording at start-up\n"
+	       "  -w  render the recording offline to a WAV file, report the speed and exit\n"
+	       "The keyboard is optional when -m is given.\n");
 }
 
-int parse_cmd_line(int argc, char** argv, int chord_vol_mask[])
+int parse_cmd_line(int argc, char** argv)
 {
-	if (argc != N_EXPECTED_PARAMS)
+	int opt = 0;
+
+	while ((opt = getopt(argc, argv, "m:r:pw:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'm':
+				midi_path = optarg;
+			break;
+			case 'r':
+				recording_path = optarg;
+			break;
+			case 'p':
+				autoplay = 1;
+			break;
+			case 'w':
+				wav_path = optarg;
+			break;
+			default:
+				return ERR_INVALID_N_PARAMS;
+		}
+	}
+
+	if (argc - optind > MAX_POSITIONAL_PARAMS)
 		return ERR_INVALID_N_PARAMS;
-		
+	if (optind < argc)
+		keyboard_path = argv[optind++];
+	if (optind < argc)
+		recording_path = argv[optind++];
+	if (wav_path != NULL)
+		return recording_path != NULL ? SUCCESS : ERR_INVALID_N_PARAMS;
+	if (keyboard_path == NULL && midi_path == NULL)
+		return ERR_INVALID_N_PARAMS;
+
 	return SUCCESS;
 }
 
-int current_WSLC()
+// Sends a block to both channels of the audio driver. The write sleeps
+// while the driver's ring is full, which is what paces this thread.
+void output_block(int block[], int n_samples)
 {
-	return *(Audio_Base + FIFOSPACE) & WSLC_MASK;
-}
+	audio_frame frames[SYNTH_BLOCK_SIZE];
+	size_t length = n_samples * sizeof(audio_frame);
+	size_t sent = 0;
+	ssize_t bytes = 0;
+	int n = 0;
 
-void buffer_overflow_preventor()
-{
-	static int buffer_shrinking = 0;
-	
-	while(current_WSLC() < 64 && buffer_shrinking){/*wait*/}
-			
-	if(current_WSLC() == 64)
+	for(n = 0; n < n_samples; n++)
 	{
-		buffer_shrinking = 0;
+		frames[n].left = block[n];
+		frames[n].right = block[n];
 	}
-	
-	if(current_WSLC() == 0)
+
+	// write() returns short once the ring fills, so send the rest
+	while(sent < length)
 	{
-		buffer_shrinking = 1;
+		bytes = write(audio_FD, (char*) frames + sent, length - sent);
+		if(bytes < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			fprintf(stderr, "Error writing to /dev/audio: %s\n", strerror(errno));
+			return;
+		}
+		sent += bytes;
 	}
 }
 
-void output_sample(int sample)
-{
-	*(Audio_Base + LDATA) = sample;
-	*(Audio_Base + RDATA) = sample;
-}
-
-// Generaters the nth sample of a sin wave of a specific frequency (freq)
-// where the sampling frequency is fs at a give volume
-int get_next_sample_for_frequency(float freq, int fs, int sample, unsigned int volume)
-{
-	return (int) (sin(2*M_PI*(freq/fs)*sample) * volume);
-}
-
 int read_from_driver_FD(int driver_FD, char buffer[], int buffer_len)
 {
 	int bytes_read = 0;
@@ -714,75 +938,6 @@ int read_from_driver_FD(int driver_FD, char buffer[], int buffer_len)
 	return 0;
 }
 
-int map_virtual(void)
-{ 
-   // Create virtual memory access to the FPGA light-weight bridge
-   if ((fd = open_physical (fd)) == -1)
-      return (-1);
-   if ((LW_Bridge = map_physical (fd, LW_BRIDGE_BASE, LW_BRIDGE_SPAN)) == NULL)
-      return (-1);
-  
-   Audio_Base = (unsigned int*) (LW_Bridge + AUDIO_BASE);
-
-return 0;
-}
-
-void unmap_virtual(void)
-{
-	unmap_physical ((void*)LW_Bridge, LW_BRIDGE_SPAN);
-	close_physical (fd);   // close /dev/mem
-}
-
-// Open /dev/mem, if not already done, to give access to physical addresses
-int open_physical (int fd)
-{
-   if (fd == -1)
-      if ((fd = open( "/dev/mem", (O_RDWR | O_SYNC))) == -1)
-      {
-         printf ("ERROR: could not open \"/dev/mem\"...\n");
-         return (-1);
-      }
-   return fd;
-}
-
-// Close /dev/mem to give access to physical addresses
-void close_physical (int fd)
-{
-   close (fd);
-}
-
-/*
- * Establish a virtual address mapping for the physical addresses starting at base, and
- * extending by span bytes.
- */
-void* map_physical(int fd, unsigned int base, unsigned int span)
-{
-   void *virtual_base;
-   
-   // Get a mapping from physical addresses to virtual addresses
-   virtual_base = mmap (NULL, span, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, base);
-   if (virtual_base == MAP_FAILED)
-   {
-      printf ("ERROR: mmap() failed...\n");
-      close (fd);
-      return (NULL);
-   }
-   return virtual_base;
-}
-
-/*
- * Close the previously-opened virtual address mapping
- */
-int unmap_physical(void* virtual_base, unsigned int span)
-{
-   if (munmap (virtual_base, span) != 0)
-   {
-      printf ("ERROR: munmap() failed...\n");
-      return (-1);
-   }
-   return 0;
-}
-
 int set_processor_affinity(unsigned int core)
 {
 	cpu_set_t cpuset;
@@ -2,21 +2,27 @@
 #define AUX_FUNCTIONS_H
 
 #include <linux/input.h>
+#include "note_queue.h"
 
 #define FREQS_IN_MIDDLE_C_SCALE     13
 #define SAMPLE_RATE                 8000
 #define MAX_VOL                     0x7FFFFFFF
-#define WSLC_MASK                   0xFF000000
-#define N_EXPECTED_PARAMS           2
-#define PARAM_KEYBOARD              1
+#define MAX_POSITIONAL_PARAMS       2                       // keyboard and recording file
 #define ERR_INVALID_N_PARAMS        -1
 #define ERR_INVALID_KBD             -2
+#define ERR_INVALID_MIDI            -3
+#define MIDI_READ_BYTES             64                      // raw MIDI bytes read per main loop pass
+#define RENDER_MAX_TAIL_S           10                      // offline render stops this long after the song
+#define FNV_OFFSET_BASIS            2166136261u             // 32-bit FNV-1a, for the render checksum
+#define FNV_PRIME                   16777619u
 #define SUCCESS                     0
 #define NO_KBD_EVENT                -1
 #define KEY_RELEASED                0
 #define KEY_PRESSED                 1
-#define INIT_FADING_INTENSITY       700000
-#define MAX_REC_TIME                6000
+#define MAX_REC_TIME_US             60000000LL              // recordings stop after a minute
+#define PLAYBACK_NONE               0
+#define PLAYBACK_START              1
+#define PLAYBACK_STOP               2
 
 #define C                           0
 #define CS_DB                       1
@@ -33,10 +39,18 @@
 #define C2                          12
 #define NO_KEY                      0xFFFF
 
+#define MIDDLE_C_NOTE               60                      // MIDI note of the C key at octave shift 0
+#define NOTE_VELOCITY               100                     // PC keyboards have no velocity
+#define MAX_OCTAVE_SHIFT            4
+#define OCTAVE_DOWN_KEY             KEY_Z
+#define OCTAVE_UP_KEY               KEY_X
+
 #define VIDEO_X_RES                 320
 #define VIDEO_Y_RES 				240
 #define GREEN						0x0F00
 #define COMMAND_STR_SIZE 			40
+#define PEAKS_CMD_STR_SIZE 			4096                    // "peaks" header and 640 coordinates
+#define SCOPE_DECIMATION            4                       // samples per scope column: 160 ms per frame
 #define VIDEO_BYTES 				8                       // number of characters to read from /dev/video
 #define KEY_BYTES                   2
 #define HEX_BYTES                   6
@@ -61,46 +75,44 @@
 #define STOPWATCH_STOP_MSG 			"stop"
 #define STOPWATCH_STOP_MSG_LEN 		5	
 
-typedef struct recording_node {
-	struct input_event ev;
-	long ev_time;
-	struct recording_node* next;
-	} recording_node;
+// One stereo frame, as written to /dev/audio
+typedef struct audio_frame {
+	int left, right;
+	} audio_frame;
 
-void note_decay(int);
-void delete_recording(void);
-long time_in_hundreths(void);
+void start_recording(void);
+void record_note(int note, int state, int velocity);
+int load_song(char* path);
+int save_song(char* path);
+int render_to_wav(char* song_path, char* path);
+void start_playback(void);
+void stop_playback(void);
 int read_from_driver_FD(int driver_FD, char buffer[], int buffer_len);
-void record_note(struct input_event kbd_event);
 void set_rec_play(int key, int* recording, int* playing);
 void control_ledr_hex(int key, int recording, int playing);
 int read_key(void);	
-void push_to_video_buffer(int sample);
+void capture_block(int block[], int n_samples);
+int scope_y(int sample);
 int find_abs_max(int array[], int size);
 void* video_thread(void*);
 int set_processor_affinity(unsigned int core);
-// Implements a quasi-exponential assympothic
-// fade to prevent changes in the DC level.
-void note_release_decay(int note);
 void* audio_thread(void*);
-void bit_mask_volume_mask(int key, int state);
+struct synth;
+int render_with_playback(struct synth* s, int block[], int* play_index, long long* play_position);
+void drain_note_events(struct synth* s);
+void apply_note_event(struct synth* s, note_event ev);
+void queue_note_event(int note, int state, int velocity);
+void play_note(int note, int state, int velocity);
+void press_piano_key(int key, int state);
 void process_individual_key(int key_code, int state);
 void update_notes_volume(struct input_event);
 struct input_event read_keyboard(int fd);
 int init_keyboard(char* dev_path);
+struct midi_parser;
+int init_midi_input(char* path);
+void read_midi_input(int fd, struct midi_parser* parser);
 void print_error(int err);
-int parse_cmd_line(int argc, char** argv, int chord_vol_mask[]);
-int current_WSLC(void);
-void buffer_overflow_preventor(void);
-void output_sample(int sample);
-// Generaters the nth sample of a sin wave of a specific frequency (freq)
-// where the sampling frequency is fs at a give volume
-int get_next_sample_for_frequency(float freq, int fs, int sample, unsigned int volume);
-int map_virtual(void);
-void unmap_virtual(void);
-int open_physical (int fd);
-void close_physical (int fd);
-void* map_physical(int fd, unsigned int base, unsigned int span);
-int unmap_physical(void* virtual_base, unsigned int span);
+int parse_cmd_line(int argc, char** argv);
+void output_block(int block[], int n_samples);
 
 #endif
@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include "aux_functions.h"
+#include "midi.h"
+
+// A note or tempo change read from a file, before the tracks are merged
+typedef struct midi_file_event {
+	long long tick;
+	int order;                                              // keeps events on the same tick in file order
+	int tempo;                                              // microseconds per quarter note, 0 for a note
+	unsigned char note;
+	unsigned char state;
+	unsigned char velocity;
+	} midi_file_event;
+
+typedef struct midi_file_events {
+	midi_file_event* events;
+	int n_events;
+	int size;
+	} midi_file_events;
+
+void midi_parser_init(midi_parser* p)
+{
+	memset(p, 0, sizeof(midi_parser));
+}
+
+// Data bytes that follow a status byte
+static int midi_data_bytes(unsigned char status)
+{
+	switch (status & 0xF0)
+	{
+		case MIDI_PROGRAM_CHANGE:
+		case MIDI_CHANNEL_PRESSURE:
+			return 1;
+		case 0xF0:
+		break;
+		default:
+			return 2;
+	}
+
+	switch (status)
+	{
+		case 0xF1:                                          // time code quarter frame
+		case 0xF3:                                          // song select
+			return 1;
+		case 0xF2:                                          // song position
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+// Returns 1 if the channel message is a note on or a note off. Any channel
+// plays the piano.
+static int midi_note(unsigned char status, const unsigned char data[], int* note, int* state, int* velocity)
+{
+	switch (status & 0xF0)
+	{
+		case MIDI_NOTE_ON:
+			// A note on with velocity 0 is a note off
+			*note = data[0];
+			*state = data[1] ? KEY_PRESSED : KEY_RELEASED;
+			*velocity = data[1];
+			return 1;
+		case MIDI_NOTE_OFF:
+			*note = data[0];
+			*state = KEY_RELEASED;
+			*velocity = 0;
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+// Feeds one byte to the parser. Returns 1 when the byte completes a note
+// on or note off, which is then in note, state and velocity.
+int midi_parse_byte(midi_parser* p, unsigned char byte, int* note, int* state, int* velocity)
+{
+	// Real time messages can be interleaved with anything and change nothing
+	if (byte >= MIDI_REALTIME)
+		return 0;
+
+	if (byte & 0x80)
+	{
+		// Sysex and system common messages cancel the running status.
+		// The data bytes of a sysex are dropped because status is 0.
+		p->expected = midi_data_bytes(byte);
+		p->status = p->expected > 0 ? byte : 0;
+		p->n_data = 0;
+		return 0;
+	}
+
+	if (p->status == 0)
+		return 0;
+
+	p->data[p->n_data++] = byte;
+	if (p->n_data < p->expected)
+		return 0;
+	p->n_data = 0;
+
+	if (p->status > MIDI_SYSEX)
+	{
+		p->status = 0;
+		return 0;
+	}
+
+	if (p->expected == 1)
+		p->data[1] = 0;
+	return midi_note(p->status, p->data, note, state, velocity);
+}
+
+// Recordings whose name ends in .mid or .midi are saved as Standard MIDI Files
+int is_midi_file(const char* path)
+{
+	const char* extension = strrchr(path, '.');
+
+	return extension != NULL &&
+	       (strcasecmp(extension, ".mid") == 0 || strcasecmp(extension, ".midi") == 0);
+}
+
+static unsigned char* put_be(unsigned char* p, unsigned int value, int n_bytes)
+{
+	while (n_bytes-- > 0)
+		*p++ = value >> (8 * n_bytes);
+	return p;
+}
+
+// Variable length quantity: 7 bits per byte, most significant first
+static unsigned char* put_vlq(unsigned char* p, unsigned int value)
+{
+	unsigned char bytes[5];
+	int n = 0;
+
+	do
+	{
+		bytes[n++] = value & 0x7F;
+		value >>= 7;
+	} while (value);
+
+	while (n > 1)
+		*p++ = bytes[--n] | 0x80;
+	*p++ = bytes[0];
+	return p;
+}
+
+// Writes a format 0 file with a single track. Returns -1 if the file
+// could not be written.
+int midi_save(recording* r, const char* path)
+{
+	// Delta time, status and two data bytes at most per event, plus the
+	// tempo and end of track meta events
+	unsigned char* track = malloc(r->n_events * 8LL + 16);
+	unsigned char header[22];
+	unsigned char* p = track;
+	unsigned char running = 0;
+	unsigned char status = 0;
+	recorded_event* ev = NULL;
+	long long last_tick = 0;
+	long long tick = 0;
+	FILE* file = NULL;
+	int err = 0;
+	int i = 0;
+
+	if (track == NULL)
+		return -1;
+
+	p = put_vlq(p, 0);
+	*p++ = MIDI_META;
+	*p++ = MIDI_META_TEMPO;
+	p = put_vlq(p, 3);
+	p = put_be(p, MIDI_TEMPO_US, 3);
+
+	for (i = 0; i < r->n_events; i++)
+	{
+		ev = recording_event(r, i);
+		tick = ((long long) ev->time_us * MIDI_DIVISION + MIDI_TEMPO_US / 2) / MIDI_TEMPO_US;
+		p = put_vlq(p, tick > last_tick ? tick - last_tick : 0);
+		if (tick > last_tick)
+			last_tick = tick;
+
+		status = ev->state == KEY_PRESSED ? MIDI_NOTE_ON : MIDI_NOTE_OFF;
+		if (status != running)
+			*p++ = running = status;
+		*p++ = ev->note & 0x7F;
+		if (ev->state == KEY_PRESSED)
+			*p++ = ev->velocity ? ev->velocity & 0x7F : NOTE_VELOCITY;
+		else
+			*p++ = MIDI_RELEASE_VELOCITY;
+	}
+
+	p = put_vlq(p, 0);
+	*p++ = MIDI_META;
+	*p++ = MIDI_META_END_OF_TRACK;
+	p = put_vlq(p, 0);
+
+	memcpy(header, "MThd", 4);
+	put_be(header + 4, 6, 4);
+	put_be(header + 8, 0, 2);                               // format 0
+	put_be(header + 10, 1, 2);                              // one track
+	put_be(header + 12, MIDI_DIVISION, 2);
+	memcpy(header + 14, "MTrk", 4);
+	put_be(header + 18, p - track, 4);
+
+	if ((file = fopen(path, "wb")) == NULL)
+		err = -1;
+	else
+	{
+		if (fwrite(header, sizeof(header), 1, file) != 1 ||
+		    fwrite(track, p - track, 1, file) != 1)
+			err = -1;
+		if (fclose(file) != 0)
+			err = -1;
+	}
+
+	free(track);
+	return err;
+}
+
+static unsigned int get_be(const unsigned char* p, int n_bytes)
+{
+	unsigned int value = 0;
+
+	while (n_bytes-- > 0)
+		value = (value << 8) | *p++;
+	return value;
+}
+
+// Returns -1 if the quantity runs past end or over four bytes
+static int get_vlq(const unsigned char** p, const unsigned char* end, unsigned int* value)
+{
+	int n = 0;
+
+	*value = 0;
+	for (n = 0; n < 4 && *p < end; n++)
+	{
+		*value = (*value << 7) | (**p & 0x7F);
+		if ((*(*p)++ & 0x80) == 0)
+			return 0;
+	}
+	return -1;
+}
+
+static int add_file_event(midi_file_events* list, long long tick, int tempo, int note, int state, int velocity)
+{
+	midi_file_event* events = NULL;
+	midi_file_event* ev = NULL;
+
+	if (list->n_events == list->size)
+	{
+		if (list->size >= RECORDING_MAX_EVENTS * 2)
+			return -1;
+		list->size = list->size ? list->size * 2 : RECORDING_CHUNK_EVENTS;
+		if ((events = realloc(list->events, list->size * sizeof(midi_file_event))) == NULL)
+			return -1;
+		list->events = events;
+	}
+
+	ev = &list->events[list->n_events];
+	ev->tick = tick;
+	ev->order = list->n_events++;
+	ev->tempo = tempo;
+	ev->note = note;
+	ev->state = state;
+	ev->velocity = velocity;
+	return 0;
+}
+
+// Collects the notes and tempo changes of one track. Returns -1 if the
+// track is malformed.
+static int read_track(const unsigned char* p, const unsigned char* end, midi_file_events* list)
+{
+	unsigned char running = 0;                              // last channel status
+	unsigned char status = 0;
+	unsigned char data[2];
+	unsigned int delta = 0;
+	unsigned int length = 0;
+	unsigned char type = 0;
+	long long tick = 0;
+	int note = 0, state = 0, velocity = 0;
+	int n = 0;
+
+	while (p < end)
+	{
+		if (get_vlq(&p, end, &delta) || p >= end)
+			return -1;
+		tick += delta;
+
+		if (*p & 0x80)
+			status = *p++;
+		else if ((status = running) == 0)
+			return -1;
+
+		if (status == MIDI_META)
+		{
+			if (p >= end)
+				return -1;
+			type = *p++;
+			if (get_vlq(&p, end, &length) || length > end - p)
+				return -1;
+			if (type == MIDI_META_END_OF_TRACK)
+				return 0;
+			if (type == MIDI_META_TEMPO && length == 3 &&
+			    add_file_event(list, tick, get_be(p, 3), 0, 0, 0))
+				return -1;
+			p += length;
+			continue;
+		}
+
+		if (status == MIDI_SYSEX || status == MIDI_SYSEX_END)
+		{
+			if (get_vlq(&p, end, &length) || length > end - p)
+				return -1;
+			p += length;
+			continue;
+		}
+
+		// System common and real time messages never appear in files
+		if (status > MIDI_SYSEX)
+			return -1;
+
+		running = status;
+		n = midi_data_bytes(status);
+		if (end - p < n)
+			return -1;
+		data[0] = p[0];
+		data[1] = n > 1 ? p[1] : 0;
+		p += n;
+
+		if (midi_note(status, data, &note, &state, &velocity) &&
+		    add_file_event(list, tick, 0, note, state, velocity))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int compare_file_events(const void* a, const void* b)
+{
+	const midi_file_event* x = a;
+	const midi_file_event* y = b;
+
+	if (x->tick != y->tick)
+		return x->tick < y->tick ? -1 : 1;
+	return x->order - y->order;
+}
+
+// Reads the whole file into memory. Returns NULL on failure.
+static unsigned char* read_file(const char* path, long* size)
+{
+	FILE* file = fopen(path, "rb");
+	unsigned char* buffer = NULL;
+
+	if (file == NULL)
+		return NULL;
+
+	if (fseek(file, 0, SEEK_END) == 0 && (*size = ftell(file)) > 0 &&
+	    *size <= MIDI_MAX_FILE_SIZE && fseek(file, 0, SEEK_SET) == 0 &&
+	    (buffer = malloc(*size)) != NULL &&
+	    fread(buffer, *size, 1, file) != 1)
+	{
+		free(buffer);
+		buffer = NULL;
+	}
+
+	fclose(file);
+	return buffer;
+}
+
+// Replaces the recording with the notes of a Standard MIDI File. The
+// tracks of format 1 and 2 files are merged, and tick times go through
+// the tempo map. Returns -1, leaving the recording empty, if the file is
+// missing, malformed or does not fit in a recording.
+int midi_load(recording* r, const char* path)
+{
+	midi_file_events list = {NULL, 0, 0};
+	midi_file_event* ev = NULL;
+	unsigned char* file = NULL;
+	const unsigned char* p = NULL;
+	const unsigned char* end = NULL;
+	unsigned int length = 0;
+	long size = 0;
+	long long division = 0;
+	long long tempo = MIDI_TEMPO_US;
+	long long base_tick = 0;
+	long long base_us = 0;
+	long long time_us = 0;
+	int smpte = 0;
+	int err = 0;
+	int i = 0;
+
+	recording_clear(r);
+	if ((file = read_file(path, &size)) == NULL)
+		return -1;
+	p = file;
+	end = file + size;
+
+	if (size < 14 || memcmp(p, "MThd", 4) || (length = get_be(p + 4, 4)) < 6 ||
+	    length > size - 8)
+	{
+		free(file);
+		return -1;
+	}
+
+	division = get_be(p + 12, 2);
+	if (division & 0x8000)
+	{
+		// SMPTE: frames per second and ticks per frame, no tempo
+		smpte = 1;
+		division = -(signed char) (division >> 8) * (division & 0xFF);
+		tempo = 1000000;
+	}
+	if (division <= 0)
+	{
+		free(file);
+		return -1;
+	}
+
+	for (p += 8 + length; end - p >= 8 && err == 0; p += 8 + length)
+	{
+		length = get_be(p + 4, 4);
+		if (length > end - p - 8)
+			err = -1;
+		else if (memcmp(p, "MTrk", 4) == 0)
+			err = read_track(p + 8, p + 8 + length, &list);
+	}
+
+	if (err == 0)
+		qsort(list.events, list.n_events, sizeof(midi_file_event), compare_file_events);
+
+	for (i = 0; i < list.n_events && err == 0; i++)
+	{
+		ev = &list.events[i];
+		time_us = base_us + (ev->tick - base_tick) * tempo / division;
+
+		if (ev->tempo)
+		{
+			if (!smpte)
+			{
+				base_tick = ev->tick;
+				base_us = time_us;
+				tempo = ev->tempo;
+			}
+		}
+		else if (time_us > UINT_MAX ||
+		         recording_append(r, time_us, ev->note, ev->state, ev->velocity) != 0)
+			err = -1;
+	}
+
+	if (err != 0)
+		recording_clear(r);
+	free(list.events);
+	free(file);
+	return err;
+}
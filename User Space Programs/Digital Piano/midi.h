@@ -0,0 +1,39 @@
+#ifndef MIDI_H
+#define MIDI_H
+
+#include "recording.h"
+
+#define MIDI_NOTE_OFF               0x80
+#define MIDI_NOTE_ON                0x90
+#define MIDI_PROGRAM_CHANGE         0xC0
+#define MIDI_CHANNEL_PRESSURE       0xD0
+#define MIDI_SYSEX                  0xF0
+#define MIDI_SYSEX_END              0xF7
+#define MIDI_REALTIME               0xF8                    // 0xF8 to 0xFF, may appear anywhere
+#define MIDI_META                   0xFF                    // in files only
+#define MIDI_META_TEMPO             0x51
+#define MIDI_META_END_OF_TRACK      0x2F
+#define MIDI_RELEASE_VELOCITY       0x40
+
+// Saved files run at 120 bpm with one tick per sample at 8 kHz, so a
+// recording keeps its sample accurate timing through a save and load.
+#define MIDI_DIVISION               4000                    // ticks per quarter note
+#define MIDI_TEMPO_US               500000                  // microseconds per quarter note
+#define MIDI_MAX_FILE_SIZE          (64 * 1024 * 1024)
+
+// Decodes a raw MIDI byte stream one byte at a time, with running status.
+// Everything but note on and note off is parsed and dropped.
+typedef struct midi_parser {
+	unsigned char status;                                   // running status, 0 if none
+	unsigned char data[2];
+	int n_data;
+	int expected;                                           // data bytes the status takes
+	} midi_parser;
+
+void midi_parser_init(midi_parser* p);
+int midi_parse_byte(midi_parser* p, unsigned char byte, int* note, int* state, int* velocity);
+int is_midi_file(const char* path);
+int midi_save(recording* r, const char* path);
+int midi_load(recording* r, const char* path);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef NOTE_QUEUE_H
+#define NOTE_QUEUE_H
+
+#include <stdatomic.h>
+
+#define NOTE_QUEUE_SIZE             256                     // must be a power of two
+
+typedef struct note_event {
+	int note;
+	int state;                                              // KEY_PRESSED or KEY_RELEASED
+	int velocity;                                           // 1 to 127, 0 for the default
+	} note_event;
+
+// Single producer, single consumer ring. Only the producer writes head
+// and only the consumer writes tail, so neither side ever waits on the
+// other. Both indexes run freely and wrap at 2^32.
+typedef struct note_queue {
+	note_event events[NOTE_QUEUE_SIZE];
+	atomic_uint head;                                       // next slot to fill
+	atomic_uint tail;                                       // next slot to drain
+	} note_queue;
+
+// Free slots, as seen by the producer. The consumer can only add to them.
+static inline unsigned int note_queue_space(note_queue* q)
+{
+	unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	return NOTE_QUEUE_SIZE - (head - tail);
+}
+
+// Returns 0 if the queue is full and the event was dropped.
+static inline int note_queue_push(note_queue* q, note_event ev)
+{
+	unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	if (head - tail == NOTE_QUEUE_SIZE)
+		return 0;
+
+	q->events[head & (NOTE_QUEUE_SIZE - 1)] = ev;
+	// Publish the event before the new head
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	return 1;
+}
+
+// Returns 0 if the queue is empty.
+static inline int note_queue_pop(note_queue* q, note_event* ev)
+{
+	unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+	if (head == tail)
+		return 0;
+
+	*ev = q->events[tail & (NOTE_QUEUE_SIZE - 1)];
+	// Hand the slot back only after it has been read
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+#endif
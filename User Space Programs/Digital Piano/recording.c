@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "recording.h"
+
+long long monotonic_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// Allocates the first chunk up front. Returns -1 if out of memory.
+int recording_init(recording* r)
+{
+	memset(r, 0, sizeof(recording));
+	r->chunks[0] = malloc(RECORDING_CHUNK_EVENTS * sizeof(recorded_event));
+
+	return r->chunks[0] == NULL ? -1 : 0;
+}
+
+// Forgets the events but keeps the chunks for the next recording
+void recording_clear(recording* r)
+{
+	r->n_events = 0;
+}
+
+void recording_free(recording* r)
+{
+	int i = 0;
+
+	for (i = 0; i < RECORDING_MAX_CHUNKS; i++)
+	{
+		free(r->chunks[i]);
+		r->chunks[i] = NULL;
+	}
+	r->n_events = 0;
+}
+
+// Returns -1 if the recording is full or a new chunk could not be allocated
+int recording_append(recording* r, unsigned int time_us, int note, int state, int velocity)
+{
+	int chunk = r->n_events / RECORDING_CHUNK_EVENTS;
+	recorded_event* ev = NULL;
+
+	if (r->n_events >= RECORDING_MAX_EVENTS)
+		return -1;
+	if (r->chunks[chunk] == NULL &&
+	    (r->chunks[chunk] = malloc(RECORDING_CHUNK_EVENTS * sizeof(recorded_event))) == NULL)
+		return -1;
+
+	ev = &r->chunks[chunk][r->n_events % RECORDING_CHUNK_EVENTS];
+	ev->time_us = time_us;
+	ev->note = note;
+	ev->state = state;
+	ev->velocity = velocity;
+	ev->reserved = 0;
+	r->n_events++;
+
+	return 0;
+}
+
+recorded_event* recording_event(recording* r, int i)
+{
+	return &r->chunks[i / RECORDING_CHUNK_EVENTS][i % RECORDING_CHUNK_EVENTS];
+}
+
+// Returns -1 if the file could not be written
+int recording_save(recording* r, const char* path)
+{
+	recording_header header;
+	FILE* file = fopen(path, "wb");
+	int remaining = r->n_events;
+	int n = 0;
+	int i = 0;
+
+	if (file == NULL)
+		return -1;
+
+	memcpy(header.magic, RECORDING_MAGIC, RECORDING_MAGIC_LEN);
+	header.n_events = r->n_events;
+	if (fwrite(&header, sizeof(header), 1, file) != 1)
+	{
+		fclose(file);
+		return -1;
+	}
+
+	// One write per chunk
+	for (i = 0; remaining > 0; i++, remaining -= n)
+	{
+		n = remaining < RECORDING_CHUNK_EVENTS ? remaining : RECORDING_CHUNK_EVENTS;
+		if (fwrite(r->chunks[i], sizeof(recorded_event), n, file) != (size_t) n)
+		{
+			fclose(file);
+			return -1;
+		}
+	}
+
+	return fclose(file) == 0 ? 0 : -1;
+}
+
+// Replaces the recording with the file's events. Returns -1, leaving the
+// recording empty, if the file is missing, truncated or not a recording.
+int recording_load(recording* r, const char* path)
+{
+	recording_header header;
+	FILE* file = fopen(path, "rb");
+	int remaining = 0;
+	int n = 0;
+	int i = 0;
+
+	recording_clear(r);
+	if (file == NULL)
+		return -1;
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+	    memcmp(header.magic, RECORDING_MAGIC, RECORDING_MAGIC_LEN) ||
+	    header.n_events > RECORDING_MAX_EVENTS)
+	{
+		fclose(file);
+		return -1;
+	}
+
+	for (i = 0, remaining = header.n_events; remaining > 0; i++, remaining -= n)
+	{
+		n = remaining < RECORDING_CHUNK_EVENTS ? remaining : RECORDING_CHUNK_EVENTS;
+		if ((r->chunks[i] == NULL &&
+		     (r->chunks[i] = malloc(RECORDING_CHUNK_EVENTS * sizeof(recorded_event))) == NULL) ||
+		    fread(r->chunks[i], sizeof(recorded_event), n, file) != (size_t) n)
+		{
+			recording_clear(r);
+			fclose(file);
+			return -1;
+		}
+	}
+
+	r->n_events = header.n_events;
+	fclose(file);
+	return 0;
+}
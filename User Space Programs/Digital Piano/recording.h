@@ -0,0 +1,42 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#define RECORDING_CHUNK_EVENTS      1024                    // events per allocation
+#define RECORDING_MAX_CHUNKS        1024                    // 1M events
+#define RECORDING_MAX_EVENTS        (RECORDING_CHUNK_EVENTS * RECORDING_MAX_CHUNKS)
+#define RECORDING_MAGIC             "DPR1"                  // file signature and format version
+#define RECORDING_MAGIC_LEN         4
+
+// One note on/off, 8 bytes in memory and on disk
+typedef struct recorded_event {
+	unsigned int time_us;                                   // since the recording started
+	unsigned char note;                                     // MIDI note
+	unsigned char state;                                    // KEY_PRESSED or KEY_RELEASED
+	unsigned char velocity;                                 // 1 to 127, 0 for the default
+	unsigned char reserved;
+	} recorded_event;
+
+// Events live in fixed size chunks that are allocated once and reused
+// by later recordings, so appending never copies or frees anything.
+typedef struct recording {
+	recorded_event* chunks[RECORDING_MAX_CHUNKS];
+	int n_events;
+	} recording;
+
+// File layout: RECORDING_MAGIC, the event count as a 32-bit integer,
+// then the events back to back.
+typedef struct recording_header {
+	char magic[RECORDING_MAGIC_LEN];
+	unsigned int n_events;
+	} recording_header;
+
+long long monotonic_us(void);
+int recording_init(recording* r);
+void recording_clear(recording* r);
+void recording_free(recording* r);
+int recording_append(recording* r, unsigned int time_us, int note, int state, int velocity);
+recorded_event* recording_event(recording* r, int i);
+int recording_save(recording* r, const char* path);
+int recording_load(recording* r, const char* path);
+
+#endif
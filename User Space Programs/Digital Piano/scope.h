@@ -0,0 +1,62 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <string.h>
+#include <stdatomic.h>
+
+#define SCOPE_COLUMNS               320                     // one per screen column
+#define SCOPE_FRESH                 4u                      // set in middle while its frame is unread
+#define SCOPE_INDEX_MASK            3u
+
+// Extremes of the samples behind each screen column
+typedef struct scope_frame {
+	int min[SCOPE_COLUMNS];
+	int max[SCOPE_COLUMNS];
+	} scope_frame;
+
+// Triple buffer between one producer and one consumer. The producer fills
+// back, the consumer draws front, and middle holds the newest complete
+// frame. Publishing and grabbing each swap an index with middle in a
+// single atomic exchange, so neither side ever waits or sees a torn frame.
+typedef struct scope_buffer {
+	scope_frame frames[3];
+	atomic_uint middle;                                     // frame index, plus SCOPE_FRESH
+	unsigned int back;                                      // producer only
+	unsigned int front;                                     // consumer only
+	} scope_buffer;
+
+static inline void scope_buffer_init(scope_buffer* b)
+{
+	memset(b->frames, 0, sizeof(b->frames));
+	b->back = 0;
+	atomic_init(&b->middle, 1);
+	b->front = 2;
+}
+
+// The frame the producer is filling
+static inline scope_frame* scope_back(scope_buffer* b)
+{
+	return &b->frames[b->back];
+}
+
+// Hands the back frame to the consumer and takes the spare one, which is
+// either the previous unread frame or one the consumer has let go of.
+static inline void scope_publish(scope_buffer* b)
+{
+	b->back = atomic_exchange_explicit(&b->middle, b->back | SCOPE_FRESH,
+	                                   memory_order_acq_rel) & SCOPE_INDEX_MASK;
+}
+
+// Returns the newest complete frame, or NULL if nothing was published
+// since the last grab.
+static inline scope_frame* scope_grab(scope_buffer* b)
+{
+	if (!(atomic_load_explicit(&b->middle, memory_order_relaxed) & SCOPE_FRESH))
+		return NULL;
+
+	b->front = atomic_exchange_explicit(&b->middle, b->front,
+	                                    memory_order_acq_rel) & SCOPE_INDEX_MASK;
+	return &b->frames[b->front];
+}
+
+#endif
@@ -0,0 +1,288 @@
+#include <math.h>
+#include <string.h>
+#include "synth.h"
+
+// One period of a sine, plus a guard entry so interpolation
+// never has to wrap the index.
+static short sine_table[SINE_TABLE_SIZE + 1];
+
+// Piano-like default: fast attack, notes die away while held and
+// stop quickly when released.
+static const envelope default_envelope = {5.0f, 1300.0f, 0.0f, 40.0f, ENV_EXPONENTIAL};
+
+void init_sine_table(void)
+{
+	int i = 0;
+
+	for (i = 0; i <= SINE_TABLE_SIZE; i++)
+		sine_table[i] = (short) lround(sin(2 * M_PI * i / SINE_TABLE_SIZE) * SINE_TABLE_AMPLITUDE);
+}
+
+void synth_init(synth* s, int sample_rate)
+{
+	int note = 0;
+
+	memset(s, 0, sizeof(synth));
+	s->sample_rate = sample_rate;
+	s->env = default_envelope;
+
+	for (note = 0; note < MIDI_NOTES; note++)
+		s->note_increment[note] = phase_increment(note_frequency(note), sample_rate);
+
+	init_sine_table();
+}
+
+// Only affects notes started afterwards
+void synth_set_envelope(synth* s, envelope env)
+{
+	s->env = env;
+}
+
+// Equal temperament around A4 = 440 Hz
+float note_frequency(int note)
+{
+	return 440.0f * powf(2.0f, (note - MIDI_A4) / 12.0f);
+}
+
+// freq/fs of a period per sample, in units of 2^-32 periods. Notes
+// above Nyquist are clamped to it.
+unsigned int phase_increment(float freq, int fs)
+{
+	if (freq * 2 >= fs)
+		return 0x80000000u;
+	return (unsigned int) llround((double) freq / fs * 4294967296.0);
+}
+
+void synth_note_on(synth* s, int note, int velocity)
+{
+	voice* v = NULL;
+
+	if (note < 0 || note >= MIDI_NOTES || velocity <= 0)
+		return;
+	if (velocity > MIDI_MAX_VELOCITY)
+		velocity = MIDI_MAX_VELOCITY;
+
+	v = allocate_voice(s, note);
+
+	// A reused voice keeps its phase and level, so the new attack
+	// starts from where the old note was instead of clicking.
+	if (v->stage == ENV_IDLE)
+	{
+		v->phase = 0;
+		v->level = 0;
+		v->amplitude = 0;
+	}
+	v->note = note;
+	v->increment = s->note_increment[note];
+	v->gain = (int) ((long long) VOICE_AMPLITUDE * velocity / MIDI_MAX_VELOCITY);
+	v->env = s->env;
+	v->stage = ENV_ATTACK;
+	v->age = s->age++;
+}
+
+void synth_note_off(synth* s, int note)
+{
+	int i = 0;
+
+	for (i = 0; i < SYNTH_VOICES; i++)
+	{
+		voice* v = &s->voices[i];
+
+		if (v->note == note && v->stage != ENV_IDLE && v->stage != ENV_RELEASE)
+			v->stage = ENV_RELEASE;
+	}
+}
+
+// Releases every sounding voice
+void synth_all_notes_off(synth* s)
+{
+	int i = 0;
+
+	for (i = 0; i < SYNTH_VOICES; i++)
+	{
+		if (s->voices[i].stage != ENV_IDLE)
+			s->voices[i].stage = ENV_RELEASE;
+	}
+}
+
+// Picks the voice for a new note: the one already playing that note,
+// else a free one, else the oldest released one, else the oldest one.
+voice* allocate_voice(synth* s, int note)
+{
+	voice* idle = NULL;
+	voice* oldest_released = NULL;
+	voice* oldest = NULL;
+	int i = 0;
+
+	for (i = 0; i < SYNTH_VOICES; i++)
+	{
+		voice* v = &s->voices[i];
+
+		if (v->stage == ENV_IDLE)
+		{
+			if (idle == NULL)
+				idle = v;
+			continue;
+		}
+		if (v->note == note)
+			return v;
+		// Ages are compared as differences, so they may wrap
+		if (v->stage == ENV_RELEASE && (oldest_released == NULL || (int) (v->age - oldest_released->age) < 0))
+			oldest_released = v;
+		if (oldest == NULL || (int) (v->age - oldest->age) < 0)
+			oldest = v;
+	}
+
+	if (idle != NULL)
+		return idle;
+	if (oldest_released != NULL)
+		return oldest_released;
+	return oldest;
+}
+
+// 1 if any voice is in its release stage
+int synth_releasing(synth* s)
+{
+	int i = 0;
+
+	for (i = 0; i < SYNTH_VOICES; i++)
+	{
+		if (s->voices[i].stage == ENV_RELEASE)
+			return 1;
+	}
+
+	return 0;
+}
+
+int synth_active_voices(synth* s)
+{
+	int i = 0;
+	int active = 0;
+
+	for (i = 0; i < SYNTH_VOICES; i++)
+	{
+		if (s->voices[i].stage != ENV_IDLE)
+			active++;
+	}
+
+	return active;
+}
+
+void synth_render(synth* s, int block[], int n_samples)
+{
+	int i = 0;
+	int n = 0;
+
+	memset(s->mix, 0, n_samples * sizeof(long long));
+
+	// Idle voices cost a single test per block
+	for (i = 0; i < SYNTH_VOICES; i++)
+	{
+		if (s->voices[i].stage != ENV_IDLE)
+			render_voice(&s->voices[i], s->mix, n_samples, s->sample_rate);
+	}
+
+	for (n = 0; n < n_samples; n++)
+	{
+		if (s->mix[n] > 0x7FFFFFFF)
+			block[n] = 0x7FFFFFFF;
+		else if (s->mix[n] < -0x7FFFFFFF)
+			block[n] = -0x7FFFFFFF;
+		else
+			block[n] = (int) s->mix[n];
+	}
+}
+
+// Adds one voice to mix. The envelope is evaluated once per block and
+// the amplitude ramps linearly to it across the block.
+void render_voice(voice* v, long long mix[], int n_samples, int sample_rate)
+{
+	unsigned int phase = v->phase;
+	unsigned int increment = v->increment;
+	int amplitude = v->amplitude;
+	int target = (int) (envelope_step(v, n_samples, sample_rate) * v->gain);
+	int step = (target - amplitude) / n_samples;
+	unsigned int index = 0;
+	int fraction = 0;
+	int wave = 0;
+	int n = 0;
+
+	for (n = 0; n < n_samples; n++)
+	{
+		index = phase >> (32 - SINE_TABLE_BITS);
+		fraction = (phase >> (32 - SINE_TABLE_BITS - SINE_FRACTION_BITS)) & ((1 << SINE_FRACTION_BITS) - 1);
+		wave = sine_table[index] + (((sine_table[index + 1] - sine_table[index]) * fraction) >> SINE_FRACTION_BITS);
+		mix[n] += ((long long) wave * amplitude) >> 15;
+
+		amplitude += step;
+		phase += increment;
+	}
+
+	v->phase = phase;
+	v->amplitude = target;
+}
+
+// Advances the envelope by n_samples and returns its new level. A voice
+// that reaches silence goes idle, after the current block ramps to 0.
+float envelope_step(voice* v, int n_samples, int sample_rate)
+{
+	float ms = n_samples * 1000.0f / sample_rate;
+	envelope* env = &v->env;
+	float level = v->level;
+
+	switch (v->stage)
+	{
+		case ENV_ATTACK:
+			if (env->attack_ms <= ms)
+				level = 1.0f;
+			else if (env->shape == ENV_LINEAR)
+				level += ms / env->attack_ms;
+			else
+				level = ENV_ATTACK_TARGET - (ENV_ATTACK_TARGET - level) *
+				        expf(-logf(ENV_ATTACK_TARGET / (ENV_ATTACK_TARGET - 1.0f)) * ms / env->attack_ms);
+
+			if (level >= 1.0f)
+			{
+				level = 1.0f;
+				v->stage = ENV_DECAY;
+			}
+		break;
+		case ENV_DECAY:
+			if (env->decay_ms <= ms)
+				level = env->sustain;
+			else if (env->shape == ENV_LINEAR)
+				level -= (1.0f - env->sustain) * ms / env->decay_ms;
+			else
+				level = env->sustain + (level - env->sustain) * expf(logf(ENV_SILENCE) * ms / env->decay_ms);
+
+			if (level - env->sustain <= ENV_SILENCE)
+			{
+				level = env->sustain;
+				v->stage = (env->sustain > 0) ? ENV_SUSTAIN : ENV_IDLE;
+			}
+		break;
+		case ENV_SUSTAIN:
+			level = env->sustain;
+		break;
+		case ENV_RELEASE:
+			if (env->release_ms <= ms)
+				level = 0;
+			else if (env->shape == ENV_LINEAR)
+				level -= ms / env->release_ms;
+			else
+				level *= expf(logf(ENV_SILENCE) * ms / env->release_ms);
+
+			if (level <= ENV_SILENCE)
+			{
+				level = 0;
+				v->stage = ENV_IDLE;
+			}
+		break;
+		default:
+			level = 0;
+		break;
+	}
+
+	v->level = level;
+	return level;
+}
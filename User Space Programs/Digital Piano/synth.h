@@ -0,0 +1,81 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#define SYNTH_BLOCK_SIZE            128                     // samples rendered per block
+#define SYNTH_VOICES                32
+#define MIDI_NOTES                  128
+#define MIDI_A4                     69                      // MIDI note of the 440 Hz A
+#define MIDI_MAX_VELOCITY           127
+#define SINE_TABLE_BITS             10
+#define SINE_TABLE_SIZE             (1 << SINE_TABLE_BITS)
+#define SINE_TABLE_AMPLITUDE        32767                   // Q15 full scale
+#define SINE_FRACTION_BITS          16                      // phase bits used to interpolate
+#define VOICE_AMPLITUDE             214748364               // one voice at full velocity: (MAX_VOL/2)/5
+#define ENV_SILENCE                 0.001f                  // -60 dB, where exponential stages end
+#define ENV_ATTACK_TARGET           1.2f                    // exponential attacks aim past full scale
+
+typedef enum envelope_stage {
+	ENV_IDLE,
+	ENV_ATTACK,
+	ENV_DECAY,
+	ENV_SUSTAIN,
+	ENV_RELEASE
+	} envelope_stage;
+
+typedef enum envelope_shape {
+	ENV_LINEAR,
+	ENV_EXPONENTIAL
+	} envelope_shape;
+
+// ADSR settings. Exponential decay and release stages reach ENV_SILENCE
+// of the distance to their target in the given time.
+typedef struct envelope {
+	float attack_ms;
+	float decay_ms;
+	float sustain;                                          // level held after decay, 0 to 1
+	float release_ms;
+	envelope_shape shape;
+	} envelope;
+
+// Phase accumulator oscillator with its own envelope. The phase wraps at
+// 2^32, which is one period of the wave, so the top SINE_TABLE_BITS bits
+// index the table.
+typedef struct voice {
+	int note;
+	unsigned int phase;
+	unsigned int increment;                                 // phase advance per sample
+	envelope_stage stage;
+	float level;                                            // envelope level at the end of the last block
+	int gain;                                               // amplitude at envelope level 1, from velocity
+	int amplitude;                                          // amplitude at the end of the last block
+	unsigned int age;                                       // note on order, for stealing
+	envelope env;
+	} voice;
+
+typedef struct synth {
+	voice voices[SYNTH_VOICES];
+	unsigned int note_increment[MIDI_NOTES];
+	envelope env;                                           // given to voices at note on
+	int sample_rate;
+	unsigned int age;
+	long long mix[SYNTH_BLOCK_SIZE];
+	} synth;
+
+void init_sine_table(void);
+void synth_init(synth* s, int sample_rate);
+void synth_set_envelope(synth* s, envelope env);
+float note_frequency(int note);
+unsigned int phase_increment(float freq, int fs);
+void synth_note_on(synth* s, int note, int velocity);
+void synth_note_off(synth* s, int note);
+void synth_all_notes_off(synth* s);
+voice* allocate_voice(synth* s, int note);
+int synth_releasing(synth* s);
+int synth_active_voices(synth* s);
+// Renders n_samples (at most SYNTH_BLOCK_SIZE) of the sum of every
+// sounding voice into block, advancing phases and envelopes.
+void synth_render(synth* s, int block[], int n_samples);
+void render_voice(voice* v, long long mix[], int n_samples, int sample_rate);
+float envelope_step(voice* v, int n_samples, int sample_rate);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include "wav.h"
+
+static void put_le(unsigned char* p, unsigned int value, int n_bytes)
+{
+	int i = 0;
+
+	for (i = 0; i < n_bytes; i++)
+		p[i] = value >> (8 * i);
+}
+
+static int write_header(wav_writer* w)
+{
+	unsigned char header[WAV_HEADER_SIZE];
+	unsigned int block_align = WAV_BITS_PER_SAMPLE / 8;
+	unsigned int data_size = w->n_samples * block_align;
+
+	memcpy(header, "RIFF", 4);
+	put_le(header + 4, WAV_HEADER_SIZE - 8 + data_size, 4);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	put_le(header + 16, 16, 4);                             // fmt chunk size
+	put_le(header + 20, 1, 2);                              // PCM
+	put_le(header + 22, 1, 2);                              // mono
+	put_le(header + 24, w->sample_rate, 4);
+	put_le(header + 28, w->sample_rate * block_align, 4);   // bytes per second
+	put_le(header + 32, block_align, 2);
+	put_le(header + 34, WAV_BITS_PER_SAMPLE, 2);
+	memcpy(header + 36, "data", 4);
+	put_le(header + 40, data_size, 4);
+
+	return fwrite(header, sizeof(header), 1, w->file) == 1 ? 0 : -1;
+}
+
+// Returns -1 if the file could not be created
+int wav_open(wav_writer* w, const char* path, int sample_rate)
+{
+	w->sample_rate = sample_rate;
+	w->n_samples = 0;
+	if ((w->file = fopen(path, "wb")) == NULL)
+		return -1;
+
+	// Placeholder sizes, rewritten by wav_close
+	if (write_header(w) != 0)
+	{
+		fclose(w->file);
+		return -1;
+	}
+	return 0;
+}
+
+// Appends samples as little endian 32-bit integers
+int wav_write(wav_writer* w, const int samples[], int n_samples)
+{
+	unsigned char bytes[4 * 256];
+	int n = 0;
+	int i = 0;
+
+	while (n_samples > 0)
+	{
+		n = n_samples < 256 ? n_samples : 256;
+		for (i = 0; i < n; i++)
+			put_le(bytes + 4 * i, samples[i], 4);
+		if (fwrite(bytes, 4, n, w->file) != (size_t) n)
+			return -1;
+
+		w->n_samples += n;
+		samples += n;
+		n_samples -= n;
+	}
+	return 0;
+}
+
+// Fills in the sizes and closes the file. Returns -1 on a write error.
+int wav_close(wav_writer* w)
+{
+	int err = 0;
+
+	if (fseek(w->file, 0, SEEK_SET) != 0 || write_header(w) != 0)
+		err = -1;
+	if (fclose(w->file) != 0)
+		err = -1;
+	w->file = NULL;
+	return err;
+}
@@ -0,0 +1,21 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <stdio.h>
+
+#define WAV_HEADER_SIZE             44
+#define WAV_BITS_PER_SAMPLE         32                      // the synth's full output, unscaled
+
+// Mono PCM WAV file being written. The sizes in the header are filled
+// in when the file is closed.
+typedef struct wav_writer {
+	FILE* file;
+	int sample_rate;
+	unsigned int n_samples;
+	} wav_writer;
+
+int wav_open(wav_writer* w, const char* path, int sample_rate);
+int wav_write(wav_writer* w, const int samples[], int n_samples);
+int wav_close(wav_writer* w);
+
+#endif
@@ -6,318 +6,935 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
-#include <sys/mman.h>
-#include "address_map_arm.h"
+#include "trigger.h"
+#include "spectrum.h"
+#include "record.h"
+#include "source.h"
+#include "sink.h"
+#include "measure.h"
 
 #define X_RES               320
-#define Y_RES               240 
+#define Y_RES               240
 #define MAX_ADC             4095
-#define ADC_DATA_MASK       0xFFF
 #define WHITE               0xFFFF
+#define YELLOW              0xFFE0
+#define CYAN                0x07FF
+#define MAGENTA             0xF81F
+#define GREEN               0x07E0
+#define ORANGE              0xFD20
+#define RED                 0xF800
+#define BLUE                0x041F
 #define COMMAND_STR_SIZE 	40
+#define WAVE_CMD_STR_SIZE	2048
+#define PEAKS_CMD_STR_SIZE	4096                        // "peaks" header and 640 coordinates
+#define STATUS_STR_SIZE		128
+#define CONFIG_LINE_SIZE	128
 #define SW_EDGE_BIT_MASK	0x01
-#define TRIGGER_THRESHOLD	1000
+#define SW_EITHER_BIT_MASK	0x02
+#define SW_CHANNEL_SHIFT	2                           // SW2 to SW9 enable channels 0 to 7
+#define ALL_CHANNELS		0xFF
+#define DEFAULT_CHANNELS	0x01
 #define VIDEO_V_OFFSET		44
 #define KEY_BYTES			2
+#define SW_BYTES			4
+#define KEY_SWEEP_UP		0x01
+#define KEY_SWEEP_DOWN		0x02
+#define KEY_REARM			0x04
+#define KEY_MODE			0x08
+#define READ_SCANS			256
+#define MAX_SAMPLE_RATE		50000                       // what the ADC driver accepts
+#define MIN_WINDOW			2
+#define MAX_WINDOW			(CAPTURE_SIZE / 2)          // the trigger needs room behind a window
+#define CONTROL_PERIOD_US	20000                       // keys and switches are read 50 times a second
+#define MARKER_SIZE			6
+#define SPECTRUM_TOP_Y		10                          // below the status line
+#define SPECTRUM_DB_RANGE	100                         // dB from the top of the screen to the bottom
+#define SPECTRUM_DB_TICK	20
+#define DEFAULT_FFT_SIZE	1024
+#define MEASURE_TEXT_ROW	51                          // one text row per channel, above the bottom edge
+#define MEASURE_PER_SECOND	5                           // at most, so the numbers stay readable
+#define ADC_FULL_SCALE_MV	4096                        // LTC2308, 0 to 4.096 V
+#define MEASURE_STR_SIZE	32
 
 
 // Global variables
-timer_t interval_timer_id;
-
-volatile unsigned int* ADC_Base = NULL;
-volatile unsigned int* SW_Base = NULL;
-volatile void* LW_Bridge = NULL;
 volatile sig_atomic_t stop = 0;
-int base_sweep_time = 100;
-int fd = -1; // used to open /dev/mem for access to physical addresses
-int samples[X_RES];
-int sampling_complete = 0;
-int video_FD = -1;                                             // video file 
-int key_FD = -1; 
-
-typedef enum trigger_type
-{
-  FALLING,
-  RISING
-} trigger_type;
+int sweep_times[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};   // ms per screen, 1-2-5 steps
+int sweep_index = 6;
+int sample_rate = MAX_SAMPLE_RATE;                             // scans per second, whatever the sweep
+source src;
+sink video = {-1};
+int key_FD = -1;                                               // no controls without the board's video
+int sw_FD = -1;
+int channel_mask = 0;                                          // channels being sampled
+int configured_mask = DEFAULT_CHANNELS;                        // used while SW2-SW9 are all down
+short int channel_colors[CAPTURE_CHANNELS] = {WHITE, YELLOW, CYAN, MAGENTA, GREEN, ORANGE, RED, BLUE};
+capture history;
+trigger trig;
+int frame_triggered = 0;
+unsigned int view_start = 0;                                   // first sample on the screen
+int view_length = 0;                                           // samples across the screen
+unsigned int trigger_sample = 0;                               // where the shown frame triggered
+spectrum spec;
+int spectrum_view = 0;                                         // KEY3 steps past the single mode into it
+int fft_size = DEFAULT_FFT_SIZE;
+int fft_averages = 1;
+int fft_peak_hold = 0;
+long long fft_us = 0;                                          // time the last frame took to transform
+measure meas;
+char record_path[CONFIG_LINE_SIZE] = "";
+char replay_path[CONFIG_LINE_SIZE] = "";
+char output_path[CONFIG_LINE_SIZE] = "";                       // video_sim commands instead of the screen
+recorder rec;
+int use_generator = 0;
+generator_wave generator = WAVE_SINE;
+double generator_frequency = GENERATOR_DEFAULT_FREQUENCY;
+int generator_amplitude = GENERATOR_DEFAULT_AMPLITUDE;
+int paced = 1;                                                 // replay and generator keep to real time
+int run_seconds = 0;                                           // 0 runs until ^C
+unsigned long frames = 0;                                      // new frames drawn, for the metrics
+long long first_frame_us = 0;
+long long latency_sum_us = 0;
+long long latency_max_us = 0;
 
 
 void clear_screen(void);
 void free_resources(void);
-void push_to_video(int samples[], int size);
-void wait_trigger(trigger_type trigger_at);
-int map_virtual(void);
-void unmap_virtual(void);
-int open_physical (int fd);
-void close_physical (int fd);
-void* map_physical(int fd, unsigned int base, unsigned int span);
-int unmap_physical(void* virtual_base, unsigned int span);
-void update_sweep_time(void);
+void push_to_video(void);
+void show_frame(unsigned int window_start, int width);
+int window_samples(void);
+int frozen(void);
+void move_view(unsigned int start, int length);
+void push_spectrum_to_video(void);
+int spectrum_y(float db);
+void cycle_view(void);
+void draw_status(void);
+void draw_measurements(void);
+void restart_measurements(void);
+void format_frequency(char* str, const measurement* r);
+void format_period(char* str, const measurement* r);
+int count_mv(double counts);
+int sample_y(int sample);
+int open_driver(char* path, int* fd);
+int open_source(void);
+int set_sample_rate(void);
+int set_channels(int mask);
+int read_scans(void);
+unsigned long long sample_ns(unsigned int i);
+void count_frame(unsigned long long newest_ns);
+void print_metrics(void);
+void update_controls(void);
+void update_sweep_time(int keys);
+int parse_cmd_line(int argc, char** argv);
+int set_option(char* name, char* value);
+int read_config(char* path);
+long long monotonic_us(void);
+long long monotonic_ns(void);
 int read_from_driver_FD(int driver_FD, char buffer[], int buffer_len);
 
 
-struct itimerspec interval_timer_start = 
-{
-  .it_interval = {.tv_sec=0,.tv_nsec=312500},
-  .it_value = {.tv_sec=0,.tv_nsec=312500}
-};
-
-struct itimerspec interval_timer_stop = 
-{
-  .it_interval = {.tv_sec=0,.tv_nsec=0},
-  .it_value = {.tv_sec=0,.tv_nsec=0}
-};
-
 void catchSIGINT(int signum){
 	stop = 1;
 }
 
-// Handler function that is called when a timeout occurs
-void timeout_handler(int signo)
-{
-  static int sample_index = 0;
+int main(int argc, char** argv){
+  unsigned int window_start = 0;
+  long long last_control_us = 0;
+  long long start_us = 0;
 
-  *ADC_Base = 0x01;	// Set ADC ready to read.
-  samples[sample_index++] = *ADC_Base & ADC_DATA_MASK;
-  if (sample_index == X_RES)
+  trigger_init(&trig);
+  if (parse_cmd_line(argc, argv) != 0)
   {
-    sample_index = 0;
-    sampling_complete = 1;
+    printf("Usage: ./Oscilloscope [-c config_file] [-m auto|normal|single] [-l level] [-y hysteresis]\n"
+           "                      [-p pretrigger_percent] [-s source_channel] [-f] [-n fft_size]\n"
+           "                      [-a averages] [-k] [-r sample_rate] [-w record_file] [-i replay_file]\n"
+           "                      [-g sine|square|noise] [-q frequency] [-v amplitude] [-u]\n"
+           "                      [-o command_file] [-t seconds]\n"
+           "-f starts in the spectrum view, -k holds the spectrum peaks.\n"
+           "-w records the channels enabled at start, -i plays a recording back instead of the ADC,\n"
+           "-g generates a test signal instead, -u runs either as fast as it can.\n"
+           "-o writes the drawing commands to a file for video_sim instead of the screen, with no\n"
+           "KEY or SW controls; -t stops after that long. Frame rate and latency are printed on exit.\n"
+           "The config file holds \"name value\" lines: channels (hex mask), source, mode, level,\n"
+           "hysteresis, pretrigger, view (time or spectrum), fft_size, average, peak_hold, rate,\n"
+           "record, replay, generator, frequency, amplitude, pace (0 or 1), output and seconds.\n"
+           "SW0 picks the rising or falling edge, SW1 triggers on either edge, SW2-SW9 pick channels 0-7.\n"
+           "KEY0/KEY1 change the sweep time, KEY2 re-arms and clears the held peaks,\n"
+           "KEY3 steps through the trigger modes and the spectrum view.\n"
+           "Once a single shot is taken the record stops: KEY0/KEY1 zoom, and KEY3 pans half a screen,\n"
+           "towards newer samples with SW0 up and older ones with SW0 down.\n");
+    return -1;
   }
-}
 
-int main(void){
- 
- 
-  // Set up the signal handling
-  struct sigaction act;
-  sigset_t set;
-  sigemptyset (&set);
-  sigaddset (&set, SIGALRM);
-  act.sa_flags = 0;
-  act.sa_mask = set;
-  act.sa_handler = &timeout_handler;
-  sigaction (SIGALRM, &act, NULL);
-  trigger_type trigger_at = FALLING;
-
-  // Open the character device driver
-  if ((video_FD = open("/dev/IntelFPGAUP/video", O_RDWR)) == -1) 
+  if (spectrum_init(&spec, fft_size, fft_averages, fft_peak_hold) != 0)
+  {
+    printf("Error allocating a %d point FFT\n", fft_size);
+    return -1;
+  }
+
+  if (open_source() != 0)
   {
-    printf("Error opening /dev/IntelFPGAUP/video: %s\n", strerror(errno));
     free_resources();
     return -1;
   }
 
-  // Open the character device driver
-  if ((key_FD = open("/dev/IntelFPGAUP/KEY", O_RDWR)) == -1) 
+  if (output_path[0] != '\0' ? sink_open_file(&video, output_path) != 0 :
+      (sink_open_video(&video, "/dev/IntelFPGAUP/video") != 0 ||
+       open_driver("/dev/IntelFPGAUP/KEY", &key_FD) != 0 ||
+       open_driver("/dev/IntelFPGAUP/SW", &sw_FD) != 0))
   {
-    printf("Error opening /dev/IntelFPGAUP/KEY: %s\n", strerror(errno));
     free_resources();
     return -1;
   }
 
-  if(map_virtual() != 0)
-	{
-		printf("Fatal error mapping virtual addresses.\n"
-		       "Aborting...\n");
-    	free_resources();
-		return -1;
-	}
-  
-  clear_screen();
+  // Acquisition runs from here on: the trigger only decides which part
+  // of the history is shown.
+  if (set_channels(configured_mask) != 0 || set_sample_rate() != 0 || source_start(&src) != 0)
+  {
+    printf("Error configuring the sample source: %s\n", strerror(errno));
+    free_resources();
+    return -1;
+  }
+  restart_measurements();
 
-  // Create a monotonically increasing timer
-  timer_create (CLOCK_MONOTONIC, NULL, &interval_timer_id);
+  if (record_path[0] != '\0' &&
+      recorder_start(&rec, record_path, &history, sample_rate, channel_mask) != 0)
+  {
+    printf("Error recording to %s: %s\n", record_path, strerror(errno));
+    record_path[0] = '\0';
+  }
+
+  clear_screen();
 
   // Catch SIGINT from ^C
   signal(SIGINT, catchSIGINT);
 
+  start_us = monotonic_us();
   while(!stop)
   {
-	trigger_at = ((*SW_Base & SW_EDGE_BIT_MASK) == 0)?FALLING:RISING;
-	update_sweep_time();
-    wait_trigger(trigger_at);
-    
-    // Starting the timer
-    timer_settime (interval_timer_id, 0, &interval_timer_start, NULL);
-    while(!sampling_complete) {/* wait */}
-    sampling_complete = 0;
-    // Stopping the timer
-    timer_settime (interval_timer_id, 0, &interval_timer_stop, NULL);
-    push_to_video(samples, X_RES);
+    if (monotonic_us() - last_control_us >= CONTROL_PERIOD_US)
+    {
+      update_controls();
+      last_control_us = monotonic_us();
+    }
+
+    if (read_scans() < 0)
+      break;
+    if (meas.fresh)
+      draw_measurements();
+    if (record_path[0] != '\0')
+      recorder_update(&rec, history.count);
+
+    if (spectrum_view)
+    {
+      long long fft_start_us = monotonic_us();
+
+      if (spectrum_poll(&spec, &history, channel_mask))
+      {
+        fft_us = monotonic_us() - fft_start_us;
+        push_spectrum_to_video();
+        count_frame(history.last_ns);
+      }
+    }
+    else if (trigger_poll(&trig, &history, window_samples(), &window_start, &frame_triggered))
+      show_frame(window_start, window_samples());
+
+    // Without the board there is nobody to press ^C
+    if (run_seconds > 0 && monotonic_us() - start_us >= run_seconds * 1000000LL)
+      stop = 1;
+    if (src.finished && key_FD == -1)
+      stop = 1;
   }
 
+  source_stop(&src);
+  if (record_path[0] != '\0')
+  {
+    if (recorder_stop(&rec) != 0)
+      printf("Error writing %s\n", record_path);
+    printf("Recorded %u scans to %s, %u dropped\n", rec.header.scans, record_path, rec.header.dropped);
+  }
   clear_screen();
+  print_metrics();
   free_resources();
-  
+  spectrum_free(&spec);
+
+  return 0;
+}
+
+// Appends whatever the source has captured to the history. The ADC
+// blocks until there is at least one scan; the other sources sleep
+// briefly when nothing is due. Returns -1 if the source failed. A stopped
+// record keeps draining the source but is no longer written.
+int read_scans(void)
+{
+  adc_scan scans[READ_SCANS];
+  int n = 0;
+  int i = 0;
+
+  if ((n = source_read(&src, scans, READ_SCANS)) <= 0)
+    return n;
+  if (frozen())
+    return 0;
+
+  for (i = 0; i < n; i++)
+  {
+    capture_push(&history, scans[i].values);
+    measure_push(&meas, scans[i].values, channel_mask);
+  }
+  history.last_ns = scans[n - 1].timestamp_ns;
+
+  return 0;
+}
+
+// A recording brings its own rate and channels
+int open_source(void)
+{
+  if (replay_path[0] != '\0')
+  {
+    if (source_open_replay(&src, replay_path) != 0)
+      return -1;
+    sample_rate = src.rate;
+    configured_mask = src.channel_mask;
+  }
+  else if (use_generator)
+    source_open_generator(&src, generator, generator_frequency, generator_amplitude);
+  else
+    return source_open_adc(&src, "/dev/adc");
+
+  src.paced = paced;
   return 0;
 }
 
-void update_sweep_time(void)
+void update_controls(void)
 {
   char key_buffer[KEY_BYTES+1];
+  char sw_buffer[SW_BYTES+1];
   int keys = 0;
-  // read the key driver
-  if(read_from_driver_FD(key_FD, key_buffer, KEY_BYTES) != 0)
-	return;
+  int switches = 0;
+  int mask = 0;
 
-  keys = atoi(key_buffer);
-  
-  switch(keys)
+  if (key_FD == -1)
+    return;
+
+  if (read_from_driver_FD(sw_FD, sw_buffer, SW_BYTES) == 0)
   {
-	case 1:
-		base_sweep_time += 100; 
-	break;
-	case 2:
-		base_sweep_time -= 100; 
-	break;
-	default:
-		return;
-	break;
+    switches = strtol(sw_buffer, NULL, 16);
+    if (switches & SW_EITHER_BIT_MASK)
+      trig.edge = EDGE_EITHER;
+    else
+      trig.edge = (switches & SW_EDGE_BIT_MASK) ? EDGE_RISING : EDGE_FALLING;
+
+    mask = (switches >> SW_CHANNEL_SHIFT) & ALL_CHANNELS;
+    if (mask == 0)
+      mask = configured_mask;
+    if (mask != channel_mask && set_channels(mask) != 0)
+      printf("Error selecting channels: %s\n", strerror(errno));
   }
 
-  if (base_sweep_time > 500)
-  {
-	base_sweep_time = 500;
+  // The KEY driver reports each press once
+  if (read_from_driver_FD(key_FD, key_buffer, KEY_BYTES) != 0)
     return;
+  keys = strtol(key_buffer, NULL, 16);
+
+  update_sweep_time(keys);
+  if ((keys & KEY_MODE) && frozen())
+    move_view(switches & SW_EDGE_BIT_MASK ? view_start + view_length / 2 : view_start - view_length / 2,
+              view_length);
+  else if (keys & KEY_MODE)
+    cycle_view();
+  if (keys & KEY_REARM)
+  {
+    trigger_rearm(&trig, &history);
+    spectrum_reset(&spec, &history);
   }
-  if (base_sweep_time < 100)
+  if (keys & (KEY_MODE | KEY_REARM))
+    draw_status();
+}
+
+void update_sweep_time(int keys)
+{
+  int previous = sweep_index;
+
+  if ((keys & KEY_SWEEP_UP) && sweep_index < (int) (sizeof(sweep_times) / sizeof(int)) - 1)
+    sweep_index++;
+  if ((keys & KEY_SWEEP_DOWN) && sweep_index > 0)
+    sweep_index--;
+
+  if (sweep_index == previous)
+    return;
+
+  // A stopped record zooms about the middle of the screen; a running one
+  // needs a trigger that fits the new window.
+  if (frozen())
+    move_view(view_start + view_length / 2 - window_samples() / 2, window_samples());
+  else
+    trigger_rearm(&trig, &history);
+  restart_measurements();
+  draw_status();
+}
+
+// Each measurement covers a sweep, or a fifth of a second if that is longer
+void restart_measurements(void)
+{
+  int length = sample_rate / MEASURE_PER_SECOND;
+
+  measure_init(&meas, sample_rate, window_samples() > length ? window_samples() : length);
+}
+
+// The sample rate stays put, so a sweep is a number of samples
+int window_samples(void)
+{
+  long long samples = (long long) sample_rate * sweep_times[sweep_index] / 1000;
+
+  if (samples < MIN_WINDOW)
+    return MIN_WINDOW;
+  return samples > MAX_WINDOW ? MAX_WINDOW : samples;
+}
+
+// A single shot has been taken and nothing new is captured
+int frozen(void)
+{
+  return !spectrum_view && trig.mode == MODE_SINGLE && trig.done;
+}
+
+void show_frame(unsigned int window_start, int width)
+{
+  trigger_sample = window_start + width * trig.pretrigger / 100;
+  view_start = window_start;
+  view_length = width;
+  push_to_video();
+  count_frame(sample_ns(window_start + width - 1));
+}
+
+// When sample i was taken, from the time of the newest scan and the rate
+unsigned long long sample_ns(unsigned int i)
+{
+  return history.last_ns - (unsigned long long) (history.count - 1 - i) * 1000000000ULL / sample_rate;
+}
+
+// Latency runs from the newest sample in a frame being taken to the frame
+// being handed to the display: what the processing adds on top of the
+// sweep itself.
+void count_frame(unsigned long long newest_ns)
+{
+  long long latency_us = (monotonic_ns() - (long long) newest_ns) / 1000;
+
+  if (frames++ == 0)
+    first_frame_us = monotonic_us();
+  latency_sum_us += latency_us;
+  if (latency_us > latency_max_us)
+    latency_max_us = latency_us;
+}
+
+void print_metrics(void)
+{
+  double seconds = (monotonic_us() - first_frame_us) / 1e6;
+
+  if (frames < 2)
   {
-	base_sweep_time = 100;
+    printf("%lu frames\n", frames);
     return;
   }
+  printf("%lu frames, %.1f fps, latency %.2f ms mean %.2f ms max, %lu commands %llu bytes\n",
+         frames, (frames - 1) / seconds, latency_sum_us / 1000.0 / frames, latency_max_us / 1000.0,
+         video.commands, video.bytes);
+}
 
-  timer_settime (interval_timer_id, 0, &interval_timer_stop, NULL);
-  interval_timer_start.it_interval.tv_nsec= base_sweep_time * 1000000 / 320;
-  interval_timer_start.it_value.tv_nsec= base_sweep_time * 1000000 / 320;
-  timer_settime (interval_timer_id, 0, &interval_timer_start, NULL);
+// Shows length samples from start, kept within the history
+void move_view(unsigned int start, int length)
+{
+  unsigned int oldest = history.count - CAPTURE_SIZE;
+
+  if (history.count < CAPTURE_SIZE)
+    oldest = 0;
+  if ((int) (history.count - start) < length)
+    start = history.count - length;
+  if ((int) (start - oldest) < 0)
+    start = oldest;
+
+  view_start = start;
+  view_length = length;
+  push_to_video();
+}
+
+// Auto, normal, single, then the spectrum of every enabled channel
+void cycle_view(void)
+{
+  if (spectrum_view)
+  {
+    spectrum_view = 0;
+    trig.mode = MODE_AUTO;
+  }
+  else if (trig.mode == MODE_SINGLE)
+    spectrum_view = 1;
+  else
+    trig.mode++;
+
+  trigger_rearm(&trig, &history);
+  spectrum_reset(&spec, &history);
+  sink_command(&video, "erase", COMMAND_STR_SIZE);
+}
+
+// Fixed for the whole run; the sweep only decides how much of the
+// history is on the screen.
+int set_sample_rate(void)
+{
+  return source_set_rate(&src, sample_rate);
+}
+
+// Every enabled channel is converted on each scan, so enabling more
+// channels does not lower the rate of any of them. The trigger moves to
+// the lowest enabled channel if its own was disabled.
+int set_channels(int mask)
+{
+  int channel = 0;
+
+  if (source_set_channels(&src, mask) != 0)
+    return -1;
+
+  channel_mask = mask;
+  if (!(mask & (1 << trig.source)))
+  {
+    for (channel = 0; !(mask & (1 << channel)); channel++);
+    trig.source = channel;
+    trigger_rearm(&trig, &history);
+  }
+  spectrum_reset(&spec, &history);
+  draw_status();
+  return 0;
+}
+
+int open_driver(char* path, int* fd)
+{
+  if ((*fd = open(path, O_RDWR)) == -1)
+  {
+    printf("Error opening %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+// Options on the command line override the config file if they come after it
+int parse_cmd_line(int argc, char** argv)
+{
+  int opt = 0;
+  int err = 0;
+
+  while ((opt = getopt(argc, argv, "c:m:l:y:p:s:fn:a:kr:w:i:g:q:v:uo:t:")) != -1 && err == 0)
+  {
+    switch (opt)
+    {
+      case 'c':
+        err = read_config(optarg);
+      break;
+      case 'm':
+        err = set_option("mode", optarg);
+      break;
+      case 'l':
+        err = set_option("level", optarg);
+      break;
+      case 'y':
+        err = set_option("hysteresis", optarg);
+      break;
+      case 'p':
+        err = set_option("pretrigger", optarg);
+      break;
+      case 's':
+        err = set_option("source", optarg);
+      break;
+      case 'f':
+        err = set_option("view", "spectrum");
+      break;
+      case 'n':
+        err = set_option("fft_size", optarg);
+      break;
+      case 'a':
+        err = set_option("average", optarg);
+      break;
+      case 'k':
+        err = set_option("peak_hold", "1");
+      break;
+      case 'r':
+        err = set_option("rate", optarg);
+      break;
+      case 'w':
+        err = set_option("record", optarg);
+      break;
+      case 'i':
+        err = set_option("replay", optarg);
+      break;
+      case 'g':
+        err = set_option("generator", optarg);
+      break;
+      case 'q':
+        err = set_option("frequency", optarg);
+      break;
+      case 'v':
+        err = set_option("amplitude", optarg);
+      break;
+      case 'u':
+        err = set_option("pace", "0");
+      break;
+      case 'o':
+        err = set_option("output", optarg);
+      break;
+      case 't':
+        err = set_option("seconds", optarg);
+      break;
+      default:
+        return -1;
+    }
+  }
+
+  return err == 0 && optind == argc ? 0 : -1;
+}
+
+// Returns -1 for an unknown setting or a value out of range
+int set_option(char* name, char* value)
+{
+  int number = atoi(value);
+
+  if (!strcmp(name, "mode"))
+  {
+    if (!strcmp(value, "auto"))
+      trig.mode = MODE_AUTO;
+    else if (!strcmp(value, "normal"))
+      trig.mode = MODE_NORMAL;
+    else if (!strcmp(value, "single"))
+      trig.mode = MODE_SINGLE;
+    else
+      return -1;
+  }
+  else if (!strcmp(name, "level") && number >= 0 && number <= MAX_ADC)
+    trig.level = number;
+  else if (!strcmp(name, "hysteresis") && number >= 0)
+    trig.hysteresis = number;
+  else if (!strcmp(name, "pretrigger") && number >= 0 && number <= 100)
+    trig.pretrigger = number;
+  else if (!strcmp(name, "source") && number >= 0 && number < CAPTURE_CHANNELS)
+  {
+    // The trigger source is always sampled
+    trig.source = number;
+    configured_mask |= 1 << number;
+  }
+  else if (!strcmp(name, "channels") && (number = strtol(value, NULL, 16)) > 0 && number <= ALL_CHANNELS)
+    configured_mask = number;
+  else if (!strcmp(name, "view") && (!strcmp(value, "time") || !strcmp(value, "spectrum")))
+    spectrum_view = !strcmp(value, "spectrum");
+  else if (!strcmp(name, "fft_size") && number >= FFT_MIN_SIZE && number <= FFT_MAX_SIZE &&
+           !(number & (number - 1)))
+    fft_size = number;
+  else if (!strcmp(name, "average") && number >= 1 && number <= SPECTRUM_MAX_AVERAGES)
+    fft_averages = number;
+  else if (!strcmp(name, "peak_hold") && (number == 0 || number == 1))
+    fft_peak_hold = number;
+  else if (!strcmp(name, "rate") && number > 0 && number <= MAX_SAMPLE_RATE)
+    sample_rate = number;
+  else if (!strcmp(name, "record") && strlen(value) < sizeof(record_path))
+    strcpy(record_path, value);
+  else if (!strcmp(name, "replay") && strlen(value) < sizeof(replay_path))
+    strcpy(replay_path, value);
+  else if (!strcmp(name, "output") && strlen(value) < sizeof(output_path))
+    strcpy(output_path, value);
+  else if (!strcmp(name, "generator"))
+  {
+    if (!strcmp(value, "sine"))
+      generator = WAVE_SINE;
+    else if (!strcmp(value, "square"))
+      generator = WAVE_SQUARE;
+    else if (!strcmp(value, "noise"))
+      generator = WAVE_NOISE;
+    else
+      return -1;
+    use_generator = 1;
+  }
+  else if (!strcmp(name, "frequency") && atof(value) > 0)
+    generator_frequency = atof(value);
+  else if (!strcmp(name, "amplitude") && number >= 0 && number <= MAX_ADC / 2)
+    generator_amplitude = number;
+  else if (!strcmp(name, "pace") && (number == 0 || number == 1))
+    paced = number;
+  else if (!strcmp(name, "seconds") && number > 0)
+    run_seconds = number;
+  else
+    return -1;
+
+  return 0;
+}
+
+// Reads "name value" lines. Blank lines and lines starting with # are skipped.
+int read_config(char* path)
+{
+  char line[CONFIG_LINE_SIZE];
+  char name[CONFIG_LINE_SIZE];
+  char value[CONFIG_LINE_SIZE];
+  FILE* file = fopen(path, "r");
+  int line_number = 0;
+
+  if (file == NULL)
+  {
+    printf("Could not open %s\n", path);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    line_number++;
+    if (sscanf(line, "%s %s", name, value) != 2 || name[0] == '#')
+      continue;
+    if (set_option(name, value) != 0)
+    {
+      printf("%s:%d: invalid setting \"%s %s\"\n", path, line_number, name, value);
+      fclose(file);
+      return -1;
+    }
+  }
+
+  fclose(file);
+  return 0;
 }
 
 void clear_screen(void)
 {
-  write (video_FD, "clear", COMMAND_STR_SIZE);
-  write (video_FD, "sync", COMMAND_STR_SIZE);
-  write (video_FD, "clear", COMMAND_STR_SIZE);
+  sink_command(&video, "clear", COMMAND_STR_SIZE);
+  sink_command(&video, "sync", COMMAND_STR_SIZE);
+  sink_command(&video, "clear", COMMAND_STR_SIZE);
+  sink_command(&video, "erase", COMMAND_STR_SIZE);
 }
 void free_resources(void)
 {
-  if (LW_Bridge != NULL)
-    unmap_virtual();
-
-  if (fd != -1)
-	  close_physical(fd);
-  
-  if (video_FD != -1)
-    close (video_FD);
+  source_close(&src);
+  sink_close(&video);
 
   if (key_FD != -1)
     close (key_FD);
+
+  if (sw_FD != -1)
+    close (sw_FD);
+}
+
+// Higher voltages are drawn higher on the screen
+int sample_y(int sample)
+{
+  return Y_RES - 1 - VIDEO_V_OFFSET - sample * Y_RES / MAX_ADC;
 }
-void push_to_video(int samples[], int size)
+
+// Draws view_length samples from view_start across the screen. Each
+// trace goes to the driver as a single "peaks" command with the extremes
+// of the samples behind every column, so however long the sweep, nothing
+// narrower than a column is lost.
+void push_to_video(void)
 {
-  char video_cmd_str[COMMAND_STR_SIZE] = "";
+  char video_cmd_str[PEAKS_CMD_STR_SIZE] = "";
+  unsigned short min[X_RES];
+  unsigned short max[X_RES];
+  int length = 0;
+  long long trigger_x = (long long) (int) (trigger_sample - view_start) * X_RES / view_length;
+  int level_y = sample_y(trig.level);
+  short int marker_color = channel_colors[trig.source];
+  int channel = 0;
   int i = 0;
 
-  write (video_FD, "clear", COMMAND_STR_SIZE);
-  for (i = 0; i < size; i++)
-  {  
-    sprintf(video_cmd_str,"line %i,%i %i,%i %04x"
-		, i
-		, (samples[i] * Y_RES / MAX_ADC + VIDEO_V_OFFSET)
-		, i + 1
-		, (samples[i+1] * Y_RES / MAX_ADC + VIDEO_V_OFFSET)
-		, WHITE);
-    write(video_FD, video_cmd_str, COMMAND_STR_SIZE);
+  sink_command(&video, "clear", COMMAND_STR_SIZE);
+
+  for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+  {
+    if (!(channel_mask & (1 << channel)))
+      continue;
+
+    capture_decimate(&history, channel, view_start, view_length, X_RES, min, max);
+    length = sprintf(video_cmd_str, "peaks 0,1 %04x", (unsigned short) channel_colors[channel]);
+    for (i = 0; i < X_RES; i++)
+      length += sprintf(video_cmd_str + length, " %i %i", sample_y(min[i]), sample_y(max[i]));
+    sink_command(&video, video_cmd_str, length);
+  }
+
+  // Trigger level on both edges of the screen, trigger point at the top,
+  // in the color of the trigger source
+  length = sprintf(video_cmd_str, "line 0,%d %d,%d %04x", level_y, MARKER_SIZE, level_y,
+                   (unsigned short) marker_color);
+  sink_command(&video, video_cmd_str, length);
+  length = sprintf(video_cmd_str, "line %d,%d %d,%d %04x", X_RES - 1 - MARKER_SIZE, level_y,
+                   X_RES - 1, level_y, (unsigned short) marker_color);
+  sink_command(&video, video_cmd_str, length);
+  if (frame_triggered && trigger_x >= 0 && trigger_x < X_RES)
+  {
+    length = sprintf(video_cmd_str, "line %d,0 %d,%d %04x", (int) trigger_x, (int) trigger_x, MARKER_SIZE,
+                     (unsigned short) marker_color);
+    sink_command(&video, video_cmd_str, length);
   }
-  write (video_FD, "sync", COMMAND_STR_SIZE);
+
+  sink_command(&video, "sync", COMMAND_STR_SIZE);
+  draw_status();
+}
+
+// 0 dB, a full scale sine, at the top; the bottom of the screen is
+// SPECTRUM_DB_RANGE below it
+int spectrum_y(float db)
+{
+  int y = SPECTRUM_TOP_Y - db * (Y_RES - 1 - SPECTRUM_TOP_Y) / SPECTRUM_DB_RANGE;
+
+  if (y < SPECTRUM_TOP_Y)
+    return SPECTRUM_TOP_Y;
+  return y > Y_RES - 1 ? Y_RES - 1 : y;
 }
-void wait_trigger(trigger_type trigger_at)
+
+// DC on the left, half the sample rate on the right. The held peaks are
+// drawn first, at half brightness, so the live trace stays on top.
+void push_spectrum_to_video(void)
 {
-  int previous_sample = (*ADC_Base & ADC_DATA_MASK);
-  int current_sample = 0;
+  char video_cmd_str[WAVE_CMD_STR_SIZE] = "";
+  float db[X_RES];
+  float peak_db[X_RES];
+  unsigned short color = 0;
+  int length = 0;
+  int channel = 0;
+  int y = 0;
+  int i = 0;
+
+  sink_command(&video, "clear", COMMAND_STR_SIZE);
+
+  for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+  {
+    if (!(channel_mask & (1 << channel)))
+      continue;
+
+    spectrum_columns(&spec, channel, X_RES, db, peak_db);
+    color = channel_colors[channel];
+
+    if (spec.peak_hold)
+    {
+      // Halves each of the RGB565 fields
+      length = sprintf(video_cmd_str, "wave 0,1 %04x", (color >> 1) & 0x7BEF);
+      for (i = 0; i < X_RES; i++)
+        length += sprintf(video_cmd_str + length, " %i", spectrum_y(peak_db[i]));
+      sink_command(&video, video_cmd_str, length);
+    }
+
+    length = sprintf(video_cmd_str, "wave 0,1 %04x", color);
+    for (i = 0; i < X_RES; i++)
+      length += sprintf(video_cmd_str + length, " %i", spectrum_y(db[i]));
+    sink_command(&video, video_cmd_str, length);
+  }
 
-  while (!stop)
+  // A tick every SPECTRUM_DB_TICK dB down the left edge
+  for (i = 0; i <= SPECTRUM_DB_RANGE; i += SPECTRUM_DB_TICK)
   {
-	*ADC_Base = 0x01;	//Setting ADC ready to read.
-    current_sample = (*ADC_Base & ADC_DATA_MASK);
-
-    if (current_sample - previous_sample > TRIGGER_THRESHOLD && trigger_at == FALLING)
-      return;
-    if (current_sample - previous_sample < -TRIGGER_THRESHOLD && trigger_at == RISING)
-      return;
-      
-    previous_sample = current_sample;
+    y = spectrum_y(-i);
+    length = sprintf(video_cmd_str, "line 0,%d %d,%d %04x", y, MARKER_SIZE, y, WHITE);
+    sink_command(&video, video_cmd_str, length);
   }
+
+  sink_command(&video, "sync", COMMAND_STR_SIZE);
+  draw_status();
 }
 
- int map_virtual(void)
-{ 
-   // Create virtual memory access to the FPGA light-weight bridge
-   if ((fd = open_physical (fd)) == -1)
-      return (-1);
-   if ((LW_Bridge = map_physical (fd, LW_BRIDGE_BASE, LW_BRIDGE_SPAN)) == NULL)
-      return (-1);
-  
-   ADC_Base = (unsigned int*) (LW_Bridge + ADC_BASE);
-   SW_Base = (unsigned int*) (LW_Bridge + SW_BASE);
+// Mode, edge, trigger state and sweep on the top text line. Fixed width,
+// so each status overwrites the last.
+void draw_status(void)
+{
+  char status[STATUS_STR_SIZE];
+  const char* state = frame_triggered ? "TRIG'D" : "FREE  ";
+  int length = 0;
+
+  // The span is half the sample rate; the transform time is the one to
+  // compare against a frame, size / rate, to see the view keeping up.
+  if (spectrum_view)
+  {
+    length = sprintf(status, "text 1,1 FFT    %4d pts  avg %2d  hold %-3s  0-%5d Hz  %5lld us  ch %02x",
+                     spec.size, spec.averages, spec.peak_hold ? "on" : "off",
+                     sample_rate / 2, fft_us, channel_mask);
+    sink_command(&video, status, length);
+    return;
+  }
+
+  if (trig.mode == MODE_SINGLE)
+    state = trig.done ? "STOP  " : "ARMED ";
 
-return 0;
+  length = sprintf(status, "text 1,1 %-6s %-7s %s %4d ms %5d S/s  pre %3d%%  level %4d  ch %02x  src %d",
+                   trigger_mode_name(trig.mode), trigger_edge_name(trig.edge), state,
+                   sweep_times[sweep_index], sample_rate, trig.pretrigger, trig.level, channel_mask,
+                   trig.source);
+  sink_command(&video, status, length);
 }
 
-void unmap_virtual(void)
+// One text row per channel under the traces, in the same fixed width so
+// a new line overwrites the last. Channels without results are blanked.
+void draw_measurements(void)
 {
-	unmap_physical ((void*)LW_Bridge, LW_BRIDGE_SPAN);
-	close_physical (fd);   // close /dev/mem
+  char text[STATUS_STR_SIZE];
+  char frequency[MEASURE_STR_SIZE];
+  char period[MEASURE_STR_SIZE];
+  char duty[MEASURE_STR_SIZE];
+  measurement* r = NULL;
+  int length = 0;
+  int channel = 0;
+
+  meas.fresh = 0;
+  for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+  {
+    r = &meas.results[channel];
+    if (!r->valid)
+    {
+      length = sprintf(text, "text 1,%d %-70s", MEASURE_TEXT_ROW + channel, "");
+      sink_command(&video, text, length);
+      continue;
+    }
+
+    format_frequency(frequency, r);
+    format_period(period, r);
+    if (r->periodic)
+      sprintf(duty, "%5.1f%%", r->duty);
+    else
+      strcpy(duty, "   -- ");
+    length = sprintf(text, "text 1,%d ch%d %11s %10s  Vpp %4d  mean %4d  rms %4d mV  duty %s",
+                     MEASURE_TEXT_ROW + channel, channel, frequency, period,
+                     count_mv(r->peak_to_peak), count_mv(r->mean), count_mv(r->rms), duty);
+    sink_command(&video, text, length);
+  }
 }
 
-// Open /dev/mem, if not already done, to give access to physical addresses
-int open_physical (int fd)
+void format_frequency(char* str, const measurement* r)
 {
-   if (fd == -1)
-      if ((fd = open( "/dev/mem", (O_RDWR | O_SYNC))) == -1)
-      {
-         printf ("ERROR: could not open \"/dev/mem\"...\n");
-         return (-1);
-      }
-   return fd;
+  if (!r->periodic)
+    strcpy(str, "    --     ");
+  else if (r->frequency < 1000)
+    sprintf(str, "%7.2f Hz ", r->frequency);
+  else
+    sprintf(str, "%7.3f kHz", r->frequency / 1000);
 }
 
-// Close /dev/mem to give access to physical addresses
-void close_physical (int fd)
+void format_period(char* str, const measurement* r)
 {
-   close (fd);
+  if (!r->periodic)
+    strcpy(str, "    --    ");
+  else if (r->period < 1e-3)
+    sprintf(str, "%7.1f us", r->period * 1e6);
+  else if (r->period < 1)
+    sprintf(str, "%7.3f ms", r->period * 1e3);
+  else
+    sprintf(str, "%7.3f s ", r->period);
 }
 
-/*
- * Establish a virtual address mapping for the physical addresses starting at base, and
- * extending by span bytes.
- */
-void* map_physical(int fd, unsigned int base, unsigned int span)
+int count_mv(double counts)
 {
-   void *virtual_base;
-   
-   // Get a mapping from physical addresses to virtual addresses
-   virtual_base = mmap (NULL, span, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, base);
-   if (virtual_base == MAP_FAILED)
-   {
-      printf ("ERROR: mmap() failed...\n");
-      close (fd);
-      return (NULL);
-   }
-   return virtual_base;
+  return counts * ADC_FULL_SCALE_MV / (MAX_ADC + 1) + 0.5;
 }
 
-/*
- * Close the previously-opened virtual address mapping
- */
-int unmap_physical(void* virtual_base, unsigned int span)
+long long monotonic_ns(void)
 {
-   if (munmap (virtual_base, span) != 0)
-   {
-      printf ("ERROR: munmap() failed...\n");
-      return (-1);
-   }
-   return 0;
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+long long monotonic_us(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
 }
 
 int read_from_driver_FD(int driver_FD, char buffer[], int buffer_len)
@@ -329,7 +946,7 @@ int read_from_driver_FD(int driver_FD, char buffer[], int buffer_len)
 		bytes_read += bytes;	// read the foo device until EOF
 		buffer[bytes_read] = '\0';
 
-		if (bytes_read != buffer_len) 
+		if (bytes_read != buffer_len)
 		{
 			fprintf (stderr, "Error: %d bytes expected from driver "
 					 "FD, but %d bytes read\n", buffer_len, bytes_read);
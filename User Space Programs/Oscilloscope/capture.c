@@ -0,0 +1,32 @@
+#include "capture.h"
+
+// Splits length samples from start into columns and keeps the extremes of
+// each, so a glitch one sample wide still shows however many samples a
+// column stands for. With fewer samples than columns, a sample spans
+// several columns.
+void capture_decimate(capture* c, int channel, unsigned int start, int length, int columns,
+                      unsigned short min[], unsigned short max[])
+{
+	const unsigned short* samples = c->samples[channel];
+	unsigned short sample = 0;
+	unsigned int first = 0, end = 0, i = 0;
+	int x = 0;
+
+	for (x = 0; x < columns; x++)
+	{
+		first = (long long) x * length / columns;
+		end = (long long) (x + 1) * length / columns;
+		if (end <= first)
+			end = first + 1;
+
+		min[x] = max[x] = samples[(start + first) & (CAPTURE_SIZE - 1)];
+		for (i = first + 1; i < end; i++)
+		{
+			sample = samples[(start + i) & (CAPTURE_SIZE - 1)];
+			if (sample < min[x])
+				min[x] = sample;
+			else if (sample > max[x])
+				max[x] = sample;
+		}
+	}
+}
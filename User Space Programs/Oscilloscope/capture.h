@@ -0,0 +1,37 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#define CAPTURE_SIZE                (1 << 20)               // samples of history per channel, a power of two
+#define CAPTURE_CHANNELS            8
+
+// Circular capture that never stops: count is the number of scans ever
+// pushed, and sample i of a channel lives at samples[channel][i % CAPTURE_SIZE].
+// Each channel is its own array, so drawing or triggering on one channel
+// walks contiguous memory. Counts wrap at 2^32 and are only ever subtracted.
+typedef struct capture
+{
+	unsigned short samples[CAPTURE_CHANNELS][CAPTURE_SIZE];
+	unsigned int count;
+	unsigned long long last_ns;                             // CLOCK_MONOTONIC time of the newest scan
+} capture;
+
+static inline int capture_sample(capture* c, int channel, unsigned int i)
+{
+	return c->samples[channel][i & (CAPTURE_SIZE - 1)];
+}
+
+// Stores one scan: values holds a sample for every channel
+static inline void capture_push(capture* c, const unsigned short values[])
+{
+	unsigned int i = c->count & (CAPTURE_SIZE - 1);
+	int channel = 0;
+
+	for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+		c->samples[channel][i] = values[channel];
+	c->count++;
+}
+
+void capture_decimate(capture* c, int channel, unsigned int start, int length, int columns,
+                      unsigned short min[], unsigned short max[]);
+
+#endif
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fft.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Returns -1 if n is not a power of two in range or memory ran out
+int fft_init(fft_plan* plan, int n)
+{
+	int bits = 0;
+	int i = 0, b = 0;
+
+	memset(plan, 0, sizeof(fft_plan));
+	if (n < FFT_MIN_SIZE || n > FFT_MAX_SIZE || (n & (n - 1)))
+		return -1;
+
+	plan->n = n;
+	plan->half = n / 2;
+	plan->twiddle_re = malloc(plan->half / 2 * sizeof(float));
+	plan->twiddle_im = malloc(plan->half / 2 * sizeof(float));
+	plan->split_re = malloc(plan->half * sizeof(float));
+	plan->split_im = malloc(plan->half * sizeof(float));
+	plan->bitrev = malloc(plan->half * sizeof(unsigned short));
+	plan->window = malloc(n * sizeof(float));
+	plan->work_re = malloc(plan->half * sizeof(float));
+	plan->work_im = malloc(plan->half * sizeof(float));
+	if (!plan->twiddle_re || !plan->twiddle_im || !plan->split_re || !plan->split_im ||
+	    !plan->bitrev || !plan->window || !plan->work_re || !plan->work_im)
+	{
+		fft_free(plan);
+		return -1;
+	}
+
+	for (i = 0; i < plan->half / 2; i++)
+	{
+		plan->twiddle_re[i] = cos(2 * M_PI * i / plan->half);
+		plan->twiddle_im[i] = -sin(2 * M_PI * i / plan->half);
+	}
+	for (i = 0; i < plan->half; i++)
+	{
+		plan->split_re[i] = cos(2 * M_PI * i / n);
+		plan->split_im[i] = -sin(2 * M_PI * i / n);
+	}
+
+	for (bits = 0; (1 << bits) < plan->half; bits++);
+	for (i = 0; i < plan->half; i++)
+	{
+		plan->bitrev[i] = 0;
+		for (b = 0; b < bits; b++)
+			if (i & (1 << b))
+				plan->bitrev[i] |= 1 << (bits - 1 - b);
+	}
+
+	// A Hann window has a coherent gain of 1/2, and a sine of amplitude A
+	// splits its energy between two bins of n*A/2 each: scaling by 4/n
+	// brings a full scale sine's bin back to A.
+	for (i = 0; i < n; i++)
+		plan->window[i] = (0.5 - 0.5 * cos(2 * M_PI * i / n)) * 4.0 / n;
+
+	return 0;
+}
+
+void fft_free(fft_plan* plan)
+{
+	free(plan->twiddle_re);
+	free(plan->twiddle_im);
+	free(plan->split_re);
+	free(plan->split_im);
+	free(plan->bitrev);
+	free(plan->window);
+	free(plan->work_re);
+	free(plan->work_im);
+	memset(plan, 0, sizeof(fft_plan));
+}
+
+// In place radix-2 decimation in time over the bit reversed work arrays
+static void fft_complex(fft_plan* plan)
+{
+	float* re = plan->work_re;
+	float* im = plan->work_im;
+	float t_re = 0, t_im = 0, w_re = 0, w_im = 0;
+	int half = plan->half;
+	int len = 0, step = 0;
+	int i = 0, j = 0;
+
+	for (len = 2, step = half / 2; len <= half; len <<= 1, step >>= 1)
+	{
+		for (i = 0; i < half; i += len)
+		{
+			for (j = 0; j < len / 2; j++)
+			{
+				int a = i + j;
+				int b = a + len / 2;
+
+				w_re = plan->twiddle_re[j * step];
+				w_im = plan->twiddle_im[j * step];
+				t_re = re[b] * w_re - im[b] * w_im;
+				t_im = re[b] * w_im + im[b] * w_re;
+				re[b] = re[a] - t_re;
+				im[b] = im[a] - t_im;
+				re[a] += t_re;
+				im[a] += t_im;
+			}
+		}
+	}
+}
+
+// Windows the n samples of x and writes the power of bins 0 to n/2,
+// scaled so a sine of amplitude A peaks at A^2.
+void fft_power(fft_plan* plan, const float* x, float* power)
+{
+	float e_re = 0, e_im = 0, o_re = 0, o_im = 0, x_re = 0, x_im = 0;
+	int half = plan->half;
+	int k = 0, m = 0;
+
+	for (m = 0; m < half; m++)
+	{
+		plan->work_re[plan->bitrev[m]] = x[2*m] * plan->window[2*m];
+		plan->work_im[plan->bitrev[m]] = x[2*m+1] * plan->window[2*m+1];
+	}
+
+	fft_complex(plan);
+
+	// Z[k] holds the transforms of the even (E) and odd (O) samples:
+	// E = (Z[k] + conj Z[half-k]) / 2, O = (Z[k] - conj Z[half-k]) / 2i,
+	// and X[k] = E + e^(-2 pi i k/n) O.
+	for (k = 0; k <= half; k++)
+	{
+		int a = k % half;
+		int b = (half - k) % half;
+
+		e_re = (plan->work_re[a] + plan->work_re[b]) / 2;
+		e_im = (plan->work_im[a] - plan->work_im[b]) / 2;
+		o_re = (plan->work_im[a] + plan->work_im[b]) / 2;
+		o_im = (plan->work_re[b] - plan->work_re[a]) / 2;
+
+		if (k == half)
+		{
+			// e^(-i pi) = -1
+			x_re = e_re - o_re;
+			x_im = e_im - o_im;
+		}
+		else
+		{
+			x_re = e_re + plan->split_re[k] * o_re - plan->split_im[k] * o_im;
+			x_im = e_im + plan->split_re[k] * o_im + plan->split_im[k] * o_re;
+		}
+		power[k] = x_re * x_re + x_im * x_im;
+	}
+}
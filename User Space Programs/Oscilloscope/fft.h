@@ -0,0 +1,29 @@
+#ifndef FFT_H
+#define FFT_H
+
+#define FFT_MIN_SIZE                64
+#define FFT_MAX_SIZE                4096
+
+// Everything a real FFT of one size needs, computed once. A real input of
+// n samples is transformed as n/2 complex points (even samples in the
+// real part, odd samples in the imaginary part), then split into the
+// n/2 + 1 bins of the real spectrum.
+typedef struct fft_plan
+{
+	int n;                                                  // real samples, a power of two
+	int half;                                               // complex points, n/2
+	float* twiddle_re;                                      // e^(-2 pi i k/half), k < half/2
+	float* twiddle_im;
+	float* split_re;                                        // e^(-2 pi i k/n), k < half
+	float* split_im;
+	unsigned short* bitrev;                                 // bit reversed index of each complex point
+	float* window;                                          // Hann, scaled so a full scale sine reads 0 dB
+	float* work_re;
+	float* work_im;
+} fft_plan;
+
+int fft_init(fft_plan* plan, int n);
+void fft_free(fft_plan* plan);
+void fft_power(fft_plan* plan, const float* x, float* power);
+
+#endif
@@ -0,0 +1,118 @@
+#include <string.h>
+#include <math.h>
+#include "measure.h"
+
+static void start_period(measure* m)
+{
+	measure_channel* c = NULL;
+	int channel = 0;
+
+	for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+	{
+		c = &m->channels[channel];
+		c->sum = 0;
+		c->sum_squares = 0;
+		c->min = c->max = -1;
+		c->rising = 0;
+		c->high = 0;
+		c->high_at_last = 0;
+	}
+	m->n = 0;
+	m->channel_mask = -1;
+}
+
+// Starts over with periods of length samples at rate
+void measure_init(measure* m, int rate, unsigned int length)
+{
+	int channel = 0;
+
+	memset(m, 0, sizeof(measure));
+	m->rate = rate;
+	m->length = length;
+	for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+	{
+		m->channels[channel].threshold = MEASURE_DEFAULT_THRESHOLD;
+		m->channels[channel].hysteresis = MEASURE_MIN_HYSTERESIS;
+	}
+	start_period(m);
+}
+
+static void finish_channel(measure* m, int channel)
+{
+	measure_channel* c = &m->channels[channel];
+	measurement* r = &m->results[channel];
+	double span = c->last_rising - c->first_rising;
+
+	r->valid = 1;
+	r->mean = (double) c->sum / m->n;
+	r->rms = sqrt((double) c->sum_squares / m->n);
+	r->peak_to_peak = c->max - c->min;
+	r->periodic = c->rising >= 2 && span > 0;
+	if (r->periodic)
+	{
+		r->period = span / (c->rising - 1) / m->rate;
+		r->frequency = 1.0 / r->period;
+		r->duty = 100.0 * c->high_at_last / span;
+	}
+
+	// The next period crosses at this one's midpoint
+	c->threshold = (c->min + c->max) / 2;
+	c->hysteresis = r->peak_to_peak / MEASURE_HYSTERESIS_DIVISOR;
+	if (c->hysteresis < MEASURE_MIN_HYSTERESIS)
+		c->hysteresis = MEASURE_MIN_HYSTERESIS;
+}
+
+static void push_sample(measure_channel* c, int sample, unsigned int n)
+{
+	c->sum += sample;
+	c->sum_squares += sample * sample;
+	if (c->min < 0 || sample < c->min)
+		c->min = sample;
+	if (sample > c->max)
+		c->max = sample;
+
+	if (c->rising > 0 && sample >= c->threshold)
+		c->high++;
+
+	if (sample < c->threshold - c->hysteresis)
+		c->armed = 1;
+	else if (c->armed && sample >= c->threshold)
+	{
+		// Where the line between the two samples meets the threshold. A
+		// crossing from the last period's final sample lands at -1 to 0.
+		c->last_rising = (double) n - 1 + (double) (c->threshold - c->previous) / (sample - c->previous);
+		if (c->rising++ == 0)
+		{
+			c->first_rising = c->last_rising;
+			c->high = 1;
+		}
+		c->high_at_last = c->high - 1;
+		c->armed = 0;
+	}
+	c->previous = sample;
+}
+
+// Adds one scan. Only channels that stay in channel_mask for the whole
+// period get results from it.
+void measure_push(measure* m, const unsigned short values[], int channel_mask)
+{
+	int channel = 0;
+
+	m->channel_mask &= channel_mask;
+	for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+		if (channel_mask & (1 << channel))
+			push_sample(&m->channels[channel], values[channel], m->n);
+
+	if (++m->n < m->length)
+		return;
+
+	for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+	{
+		if (m->channel_mask & (1 << channel))
+			finish_channel(m, channel);
+		else
+			m->results[channel].valid = 0;
+	}
+	m->fresh = 1;
+	start_period(m);
+}
@@ -0,0 +1,55 @@
+#ifndef MEASURE_H
+#define MEASURE_H
+
+#include "capture.h"
+
+#define MEASURE_MIN_HYSTERESIS      8                       // ADC counts, above the converter's noise
+#define MEASURE_HYSTERESIS_DIVISOR  10                      // a tenth of the last peak to peak
+#define MEASURE_DEFAULT_THRESHOLD   2048
+
+// Running sums for one channel over the current measurement period. They
+// are updated as each sample is captured, so results cost nothing extra
+// when the period ends. Crossings are timed against the previous period's
+// midpoint, with hysteresis so noise on a slow edge counts once.
+typedef struct measure_channel
+{
+	unsigned long long sum;
+	unsigned long long sum_squares;
+	int min, max;
+	int threshold;
+	int hysteresis;
+	int armed;                                              // below threshold - hysteresis since the last crossing
+	int previous;
+	int rising;                                             // rising crossings this period
+	double first_rising, last_rising;                       // their positions, in samples with fractions
+	unsigned int high;                                      // samples at or over threshold since the first crossing
+	unsigned int high_at_last;                              // high when the last crossing came
+} measure_channel;
+
+typedef struct measurement
+{
+	int valid;                                              // the channel was sampled for a whole period
+	int periodic;                                           // two rising crossings or more were seen
+	double frequency;                                       // Hz
+	double period;                                          // seconds
+	double duty;                                            // percent of a period at or over the midpoint
+	double mean;                                            // ADC counts
+	double rms;                                             // ADC counts, including the mean
+	int peak_to_peak;                                       // ADC counts
+} measurement;
+
+typedef struct measure
+{
+	measure_channel channels[CAPTURE_CHANNELS];
+	measurement results[CAPTURE_CHANNELS];                  // from the last complete period
+	int rate;
+	unsigned int length;                                    // samples per period
+	unsigned int n;                                         // samples so far this period
+	int channel_mask;                                       // channels measured this period
+	int fresh;                                              // results changed since the caller last looked
+} measure;
+
+void measure_init(measure* m, int rate, unsigned int length);
+void measure_push(measure* m, const unsigned short values[], int channel_mask);
+
+#endif
@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "record.h"
+
+static int write_buffer(recorder* r)
+{
+	int done = 0;
+	int bytes = 0;
+
+	while (done < r->fill)
+	{
+		if ((bytes = write(r->fd, r->buffer + done, r->fill - done)) < 0)
+		{
+			r->error = 1;
+			return -1;
+		}
+		done += bytes;
+	}
+	r->fill = 0;
+	return 0;
+}
+
+// Returns 1 if the buffer filled and went to disk
+static int put_sample(recorder* r, int sample)
+{
+	if (r->half < 0)
+	{
+		r->half = sample;
+		return 0;
+	}
+
+	r->buffer[r->fill++] = r->half & 0xFF;
+	r->buffer[r->fill++] = (r->half >> 8) | ((sample & 0x0F) << 4);
+	r->buffer[r->fill++] = sample >> 4;
+	r->half = -1;
+	if (r->fill < RECORD_BUFFER_SIZE)
+		return 0;
+	write_buffer(r);
+	return 1;
+}
+
+// Packs whatever the acquisition has published, until told to stop and
+// everything published is on disk.
+static void* writer_thread(void* arg)
+{
+	recorder* r = arg;
+	unsigned int available = 0;
+	int running = 0;
+	int flushed = 0;
+	int channel = 0;
+
+	while (!r->error)
+	{
+		running = atomic_load_explicit(&r->running, memory_order_acquire);
+		available = atomic_load_explicit(&r->available, memory_order_acquire);
+
+		if (available - r->next > RECORD_MAX_LAG)
+		{
+			r->header.dropped += available - RECORD_MAX_LAG - r->next;
+			r->next = available - RECORD_MAX_LAG;
+		}
+
+		if (available == r->next)
+		{
+			if (!running)
+				break;
+			usleep(RECORD_IDLE_US);
+			continue;
+		}
+
+		// A write can stall on the disk while the acquisition keeps
+		// overwriting the ring, so check the lag again after each one
+		for (flushed = 0; r->next != available && !r->error && !flushed; r->next++, r->header.scans++)
+			for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+				if (r->header.channel_mask & (1 << channel))
+					flushed |= put_sample(r, capture_sample(r->source, channel, r->next));
+	}
+
+	return NULL;
+}
+
+// Records the channels in channel_mask from the capture's current count on
+int recorder_start(recorder* r, const char* path, capture* c, int rate, int channel_mask)
+{
+	const void* header = &r->header;
+	struct timespec now;
+
+	memset(r, 0, sizeof(recorder));
+	r->half = -1;
+	r->source = c;
+	r->next = c->count;
+	atomic_init(&r->available, c->count);
+	atomic_init(&r->running, 1);
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	memcpy(r->header.magic, RECORD_MAGIC, RECORD_MAGIC_SIZE);
+	r->header.version = RECORD_VERSION;
+	r->header.rate = rate;
+	r->header.channel_mask = channel_mask;
+	r->header.bits = RECORD_BITS;
+	r->header.header_size = sizeof(record_header);
+	r->header.start_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+	if ((r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return -1;
+	if (posix_memalign((void**) &r->buffer, RECORD_ALIGNMENT, RECORD_BUFFER_SIZE) != 0)
+		r->buffer = NULL;
+
+	// The header is written again with the totals on close
+	if (r->buffer == NULL || write(r->fd, header, sizeof(record_header)) != sizeof(record_header) ||
+	    pthread_create(&r->thread, NULL, &writer_thread, r) != 0)
+	{
+		free(r->buffer);
+		close(r->fd);
+		r->fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Called by the acquisition after pushing scans to the capture
+void recorder_update(recorder* r, unsigned int count)
+{
+	atomic_store_explicit(&r->available, count, memory_order_release);
+}
+
+// Writes out everything published so far and closes the file. Returns -1
+// if any write failed.
+int recorder_stop(recorder* r)
+{
+	const void* header = &r->header;
+
+	atomic_store_explicit(&r->running, 0, memory_order_release);
+	pthread_join(r->thread, NULL);
+
+	if (r->half >= 0)
+		put_sample(r, 0);
+	if (!r->error)
+		write_buffer(r);
+	if (pwrite(r->fd, header, sizeof(record_header), 0) != sizeof(record_header))
+		r->error = 1;
+
+	close(r->fd);
+	free(r->buffer);
+	r->fd = -1;
+	return r->error ? -1 : 0;
+}
+
+static int channels_in(int mask)
+{
+	int n = 0;
+
+	for (; mask; mask >>= 1)
+		n += mask & 1;
+	return n;
+}
+
+// Returns -1 if the file is not a recording
+int record_open(record_reader* r, const char* path)
+{
+	struct stat st;
+	long long samples = 0;
+
+	memset(r, 0, sizeof(record_reader));
+	r->half = -1;
+	if ((r->file = fopen(path, "rb")) == NULL)
+		return -1;
+
+	if (fread(&r->header, sizeof(record_header), 1, r->file) != 1 ||
+	    memcmp(r->header.magic, RECORD_MAGIC, RECORD_MAGIC_SIZE) ||
+	    r->header.version != RECORD_VERSION || r->header.bits != RECORD_BITS ||
+	    r->header.channel_mask == 0 || r->header.rate == 0 ||
+	    fseek(r->file, r->header.header_size, SEEK_SET) != 0 || fstat(fileno(r->file), &st) != 0)
+	{
+		record_close(r);
+		return -1;
+	}
+
+	// A recording that was never closed still holds every whole pair
+	r->scans_left = r->header.scans;
+	if (r->scans_left == 0)
+	{
+		samples = (st.st_size - r->header.header_size) / 3 * 2;
+		r->scans_left = samples / channels_in(r->header.channel_mask);
+	}
+	return 0;
+}
+
+static int get_sample(record_reader* r)
+{
+	unsigned char pair[3];
+	int sample = r->half;
+
+	if (sample >= 0)
+	{
+		r->half = -1;
+		return sample;
+	}
+
+	if (fread(pair, sizeof(pair), 1, r->file) != 1)
+		return -1;
+	r->half = (pair[1] >> 4) | (pair[2] << 4);
+	return pair[0] | ((pair[1] & 0x0F) << 8);
+}
+
+// Unpacks up to max_scans scans into values, with 0 for the channels that
+// were not recorded. Returns the number of scans read, 0 at the end.
+int record_read(record_reader* r, unsigned short values[][CAPTURE_CHANNELS], int max_scans)
+{
+	int sample = 0;
+	int channel = 0;
+	int n = 0;
+
+	for (n = 0; n < max_scans && r->scans_left > 0; n++, r->scans_left--)
+	{
+		for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+		{
+			values[n][channel] = 0;
+			if (!(r->header.channel_mask & (1 << channel)))
+				continue;
+			if ((sample = get_sample(r)) < 0)
+			{
+				r->scans_left = 0;
+				return n;
+			}
+			values[n][channel] = sample;
+		}
+	}
+	return n;
+}
+
+void record_close(record_reader* r)
+{
+	if (r->file != NULL)
+		fclose(r->file);
+	r->file = NULL;
+}
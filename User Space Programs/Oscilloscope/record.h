@@ -0,0 +1,71 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "capture.h"
+
+#define RECORD_MAGIC                "ADCREC"
+#define RECORD_MAGIC_SIZE           6
+#define RECORD_VERSION              1
+#define RECORD_BITS                 12
+#define RECORD_BUFFER_SIZE          (3 * 256 * 1024)        // whole sample pairs and whole 4 KiB pages
+#define RECORD_ALIGNMENT            4096
+#define RECORD_IDLE_US              10000
+#define RECORD_MAX_LAG              (CAPTURE_SIZE / 2)      // scans the writer may fall behind before it skips
+
+// A recording is this header followed by the samples of the enabled
+// channels, scan after scan, in channel order. Samples are packed two to
+// three bytes: the first sample's low byte, its high nibble with the
+// second sample's low nibble above it, then the second sample's high
+// byte. An odd last sample is padded to a pair. Little endian throughout.
+typedef struct record_header
+{
+	char magic[RECORD_MAGIC_SIZE];
+	unsigned short version;
+	unsigned int rate;                                      // scans per second
+	unsigned char channel_mask;
+	unsigned char bits;
+	unsigned short header_size;
+	unsigned int scans;                                     // filled in on close, 0 if the recorder never closed
+	unsigned int dropped;                                   // scans the writer fell too far behind to save
+	unsigned long long start_ns;                            // wall clock time of the first scan
+} record_header;
+
+// Streams a capture to a file from its own thread. The acquisition only
+// publishes how far the capture has got; the writer packs the new scans
+// straight out of the capture ring, which is deep enough to ride out a
+// slow disk for seconds.
+typedef struct recorder
+{
+	int fd;
+	record_header header;
+	capture* source;
+	unsigned char* buffer;                                  // RECORD_ALIGNMENT aligned
+	int fill;
+	int half;                                               // a sample waiting for its pair, or -1
+	unsigned int next;                                      // next scan to write
+	atomic_uint available;                                  // capture count, published by the acquisition
+	atomic_int running;
+	int error;
+	pthread_t thread;
+} recorder;
+
+// Unpacks a recording scan by scan
+typedef struct record_reader
+{
+	FILE* file;
+	record_header header;
+	unsigned int scans_left;
+	int half;                                               // the second sample of the last pair, or -1
+} record_reader;
+
+int recorder_start(recorder* r, const char* path, capture* c, int rate, int channel_mask);
+void recorder_update(recorder* r, unsigned int count);
+int recorder_stop(recorder* r);
+int record_open(record_reader* r, const char* path);
+int record_read(record_reader* r, unsigned short values[][CAPTURE_CHANNELS], int max_scans);
+void record_close(record_reader* r);
+
+#endif
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "sink.h"
+
+static int open_sink(sink* k, const char* path, int flags, int lines)
+{
+	memset(k, 0, sizeof(sink));
+	k->lines = lines;
+	if ((k->fd = open(path, flags, 0644)) == -1)
+	{
+		printf("Error opening %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int sink_open_video(sink* k, const char* path)
+{
+	return open_sink(k, path, O_RDWR, 0);
+}
+
+int sink_open_file(sink* k, const char* path)
+{
+	return open_sink(k, path, O_WRONLY | O_CREAT | O_TRUNC, 1);
+}
+
+// Commands are passed the way the driver takes them: short ones padded
+// to a fixed size, so a file keeps only what comes before the terminator.
+void sink_command(sink* k, const char* command, int length)
+{
+	if (k->lines)
+	{
+		length = strnlen(command, length);
+		write (k->fd, command, length);
+		write (k->fd, "\n", 1);
+		length++;
+	}
+	else
+		write (k->fd, command, length);
+
+	k->commands++;
+	k->bytes += length;
+}
+
+void sink_close(sink* k)
+{
+	if (k->fd != -1)
+		close (k->fd);
+	k->fd = -1;
+}
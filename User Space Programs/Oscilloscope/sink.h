@@ -0,0 +1,19 @@
+#ifndef SINK_H
+#define SINK_H
+
+// Where drawing commands go: the video driver, which takes one command
+// per write(), or a file of one command per line that video_sim can draw.
+typedef struct sink
+{
+	int fd;
+	int lines;                                              // a file for video_sim
+	unsigned long commands;
+	unsigned long long bytes;
+} sink;
+
+int sink_open_video(sink* k, const char* path);
+int sink_open_file(sink* k, const char* path);
+void sink_command(sink* k, const char* command, int length);
+void sink_close(sink* k);
+
+#endif
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "source.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static long long monotonic_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Scans a paced source owes since it started, at most max_scans. Sleeps
+// briefly when none are due, so the main loop does not spin.
+static int scans_due(source* s, int max_scans)
+{
+	long long due = 0;
+
+	if (!s->paced)
+		return max_scans;
+
+	due = (monotonic_ns() - s->start_ns) * s->rate / 1000000000LL - (long long) s->delivered;
+	if (due <= 0)
+	{
+		usleep(SOURCE_IDLE_US);
+		return 0;
+	}
+	return due < max_scans ? due : max_scans;
+}
+
+// When scan i of a paced source was due, or now for an unpaced one
+static unsigned long long scan_time(source* s, unsigned long long i)
+{
+	if (!s->paced)
+		return monotonic_ns();
+	return s->start_ns + i * 1000000000ULL / s->rate;
+}
+
+static int no_op(source* s)
+{
+	return 0;
+}
+
+// Paced sources count time from here
+static int start_clock(source* s)
+{
+	s->start_ns = monotonic_ns();
+	s->delivered = 0;
+	return 0;
+}
+
+static int keep_rate(source* s, int rate)
+{
+	s->rate = rate;
+	return 0;
+}
+
+static int keep_channels(source* s, int mask)
+{
+	s->channel_mask = mask;
+	return 0;
+}
+
+
+// The ADC driver, configured with its text commands
+
+static int adc_command(source* s, char* command)
+{
+	return write (s->fd, command, strlen(command)) < 0 ? -1 : 0;
+}
+
+static int adc_set_rate(source* s, int rate)
+{
+	char command[SOURCE_COMMAND_SIZE];
+
+	sprintf(command, "rate %d", rate);
+	s->rate = rate;
+	return adc_command(s, command);
+}
+
+static int adc_set_channels(source* s, int mask)
+{
+	char command[SOURCE_COMMAND_SIZE];
+
+	sprintf(command, "channels %x", mask);
+	s->channel_mask = mask;
+	return adc_command(s, command);
+}
+
+static int adc_start(source* s)
+{
+	return adc_command(s, "start");
+}
+
+static int adc_stop(source* s)
+{
+	return adc_command(s, "stop");
+}
+
+// Blocks until the driver has at least one scan
+static int adc_read(source* s, adc_scan scans[], int max_scans)
+{
+	int bytes = read (s->fd, scans, max_scans * sizeof(adc_scan));
+
+	if (bytes < 0)
+		return errno == EINTR ? 0 : -1;
+	return bytes / sizeof(adc_scan);
+}
+
+static void adc_close(source* s)
+{
+	if (s->fd != -1)
+		close (s->fd);
+	s->fd = -1;
+}
+
+static const source_ops adc_ops = {adc_set_rate, adc_set_channels, adc_start, adc_stop, adc_read, adc_close};
+
+int source_open_adc(source* s, const char* path)
+{
+	memset(s, 0, sizeof(source));
+	s->ops = &adc_ops;
+	if ((s->fd = open(path, O_RDWR)) == -1)
+	{
+		printf("Error opening %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+
+// A recording, fed in at the rate it was made. Its rate cannot change;
+// channels it did not record read 0.
+
+static int replay_set_rate(source* s, int rate)
+{
+	return rate == s->rate ? 0 : -1;
+}
+
+static int replay_read(source* s, adc_scan scans[], int max_scans)
+{
+	unsigned short values[SOURCE_MAX_BATCH][CAPTURE_CHANNELS];
+	int n = scans_due(s, max_scans < SOURCE_MAX_BATCH ? max_scans : SOURCE_MAX_BATCH);
+	int channel = 0;
+	int i = 0;
+
+	if (n == 0)
+		return 0;
+	if ((n = record_read(&s->reader, values, n)) == 0)
+	{
+		s->finished = 1;
+		if (!s->paced)
+			usleep(SOURCE_IDLE_US);
+		return 0;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		scans[i].timestamp_ns = scan_time(s, s->delivered);
+		scans[i].index = s->delivered++;
+		scans[i].channel_mask = s->channel_mask;
+		for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+			scans[i].values[channel] = (s->channel_mask & (1 << channel)) ? values[i][channel] : 0;
+	}
+	return n;
+}
+
+static void replay_close(source* s)
+{
+	record_close(&s->reader);
+}
+
+static const source_ops replay_ops = {replay_set_rate, keep_channels, start_clock, no_op, replay_read, replay_close};
+
+int source_open_replay(source* s, const char* path)
+{
+	memset(s, 0, sizeof(source));
+	s->ops = &replay_ops;
+	s->paced = 1;
+	if (record_open(&s->reader, path) != 0)
+	{
+		printf("Error opening recording %s\n", path);
+		return -1;
+	}
+	s->rate = s->reader.header.rate;
+	s->channel_mask = s->reader.header.channel_mask;
+	return 0;
+}
+
+
+// A test signal on every enabled channel, each an eighth of a cycle
+// behind the one before so the traces can be told apart.
+
+static int generate(source* s, int channel)
+{
+	double phase = s->phase - channel / 8.0;
+	int value = 0;
+
+	phase -= floor(phase);
+	switch (s->wave)
+	{
+		case WAVE_SINE:
+			value = GENERATOR_OFFSET + s->amplitude * sin(2 * M_PI * phase);
+		break;
+		case WAVE_SQUARE:
+			value = GENERATOR_OFFSET + (phase < 0.5 ? s->amplitude : -s->amplitude);
+		break;
+		case WAVE_NOISE:
+			// xorshift32
+			s->seed ^= s->seed << 13;
+			s->seed ^= s->seed >> 17;
+			s->seed ^= s->seed << 5;
+			value = GENERATOR_OFFSET + (int) (s->seed % (2 * s->amplitude + 1)) - s->amplitude;
+		break;
+	}
+
+	if (value < 0)
+		return 0;
+	return value > GENERATOR_MAX_SAMPLE ? GENERATOR_MAX_SAMPLE : value;
+}
+
+static int generator_read(source* s, adc_scan scans[], int max_scans)
+{
+	int n = scans_due(s, max_scans);
+	int channel = 0;
+	int i = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		scans[i].timestamp_ns = scan_time(s, s->delivered);
+		scans[i].index = s->delivered++;
+		scans[i].channel_mask = s->channel_mask;
+		for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+			scans[i].values[channel] = (s->channel_mask & (1 << channel)) ? generate(s, channel) : 0;
+
+		s->phase += s->frequency / s->rate;
+		s->phase -= floor(s->phase);
+	}
+	return n;
+}
+
+static void generator_close(source* s)
+{
+}
+
+static const source_ops generator_ops = {keep_rate, keep_channels, start_clock, no_op, generator_read,
+                                         generator_close};
+
+int source_open_generator(source* s, generator_wave wave, double frequency, int amplitude)
+{
+	memset(s, 0, sizeof(source));
+	s->ops = &generator_ops;
+	s->paced = 1;
+	s->wave = wave;
+	s->frequency = frequency;
+	s->amplitude = amplitude;
+	s->seed = 1;
+	return 0;
+}
+
+
+int source_set_rate(source* s, int rate)
+{
+	return s->ops->set_rate(s, rate);
+}
+
+int source_set_channels(source* s, int mask)
+{
+	return s->ops->set_channels(s, mask);
+}
+
+int source_start(source* s)
+{
+	return s->ops->start(s);
+}
+
+int source_stop(source* s)
+{
+	return s->ops->stop(s);
+}
+
+int source_read(source* s, adc_scan scans[], int max_scans)
+{
+	return s->ops->read(s, scans, max_scans);
+}
+
+// Safe on a source that was never opened
+void source_close(source* s)
+{
+	if (s->ops != NULL)
+		s->ops->close(s);
+	s->ops = NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include "adc_ring.h"
+#include "record.h"
+
+#define SOURCE_IDLE_US              1000                    // a paced source with nothing due sleeps this long
+#define SOURCE_COMMAND_SIZE         40
+#define SOURCE_MAX_BATCH            256                     // scans a replay unpacks per read
+#define GENERATOR_DEFAULT_FREQUENCY 1000.0
+#define GENERATOR_DEFAULT_AMPLITUDE 1500
+#define GENERATOR_OFFSET            2048                    // mid-scale, like a biased input
+#define GENERATOR_MAX_SAMPLE        4095
+
+typedef enum generator_wave
+{
+	WAVE_SINE,
+	WAVE_SQUARE,
+	WAVE_NOISE
+} generator_wave;
+
+typedef struct source source;
+
+// What the oscilloscope needs from anything that produces scans. read()
+// returns the number of scans stored, 0 if none are ready yet, -1 on an
+// error. Scans carry their CLOCK_MONOTONIC sampling time, so latency can
+// be measured the same way whatever the source.
+typedef struct source_ops
+{
+	int (*set_rate)(source* s, int rate);
+	int (*set_channels)(source* s, int mask);
+	int (*start)(source* s);
+	int (*stop)(source* s);
+	int (*read)(source* s, adc_scan scans[], int max_scans);
+	void (*close)(source* s);
+} source_ops;
+
+struct source
+{
+	const source_ops* ops;
+	int rate;
+	int channel_mask;
+	int paced;                                              // replay and generator: keep to real time
+	int finished;                                           // a replay reached its end
+	long long start_ns;
+	unsigned long long delivered;                           // scans handed out since start
+
+	int fd;                                                 // /dev/adc
+	record_reader reader;                                   // replay
+	generator_wave wave;                                    // generator
+	double frequency;
+	int amplitude;
+	double phase;                                           // in cycles
+	unsigned int seed;
+};
+
+int source_open_adc(source* s, const char* path);
+int source_open_replay(source* s, const char* path);
+int source_open_generator(source* s, generator_wave wave, double frequency, int amplitude);
+int source_set_rate(source* s, int rate);
+int source_set_channels(source* s, int mask);
+int source_start(source* s);
+int source_stop(source* s);
+int source_read(source* s, adc_scan scans[], int max_scans);
+void source_close(source* s);
+
+#endif
@@ -0,0 +1,119 @@
+#include <string.h>
+#include <math.h>
+#include "spectrum.h"
+
+int spectrum_init(spectrum* s, int size, int averages, int peak_hold)
+{
+	if (averages < 1 || averages > SPECTRUM_MAX_AVERAGES || fft_init(&s->plan, size) != 0)
+		return -1;
+
+	s->size = size;
+	s->averages = averages;
+	s->peak_hold = peak_hold;
+	s->last = 0;
+	s->frames = 0;
+	return 0;
+}
+
+void spectrum_free(spectrum* s)
+{
+	fft_free(&s->plan);
+}
+
+// Drops the average and the held peaks, and waits for a whole new frame
+void spectrum_reset(spectrum* s, capture* c)
+{
+	s->last = c->count;
+	s->frames = 0;
+}
+
+// Returns 1 when a new frame was transformed
+int spectrum_poll(spectrum* s, capture* c, int channel_mask)
+{
+	unsigned int start = c->count - s->size;
+	float mean = 0;
+	float weight = 0;
+	int channel = 0;
+	int i = 0;
+
+	if (c->count - s->last < (unsigned int) s->size)
+		return 0;
+	s->last = c->count;
+
+	// Until the average is full every frame counts the same, so the first
+	// frames are not weighed down by the empty average.
+	if (s->frames < s->averages)
+		s->frames++;
+	weight = 1.0f / s->frames;
+
+	for (channel = 0; channel < CAPTURE_CHANNELS; channel++)
+	{
+		if (!(channel_mask & (1 << channel)))
+			continue;
+
+		// The ADC is unipolar: without the mean its offset would swamp
+		// the low bins through the window's leakage.
+		mean = 0;
+		for (i = 0; i < s->size; i++)
+		{
+			s->frame[i] = capture_sample(c, channel, start + i);
+			mean += s->frame[i];
+		}
+		mean /= s->size;
+		for (i = 0; i < s->size; i++)
+			s->frame[i] -= mean;
+
+		fft_power(&s->plan, s->frame, s->bins);
+
+		for (i = 0; i <= s->size / 2; i++)
+		{
+			if (s->frames == 1)
+				s->power[channel][i] = s->bins[i];
+			else
+				s->power[channel][i] += (s->bins[i] - s->power[channel][i]) * weight;
+
+			if (s->frames == 1 || !s->peak_hold || s->power[channel][i] > s->peak[channel][i])
+				s->peak[channel][i] = s->power[channel][i];
+		}
+	}
+
+	return 1;
+}
+
+static float power_db(float power)
+{
+	if (power <= 0)
+		return SPECTRUM_FLOOR_DB;
+	return 10 * log10f(power / (SPECTRUM_FULL_SCALE * SPECTRUM_FULL_SCALE));
+}
+
+// Fits bins 0 to size/2 into columns, in dB relative to full scale. A
+// column covering several bins shows the strongest, so narrow peaks
+// survive; with fewer bins than columns a bin spans several columns.
+void spectrum_columns(spectrum* s, int channel, int columns, float db[], float peak_db[])
+{
+	int bins = s->size / 2 + 1;
+	float power = 0, peak = 0;
+	int first = 0, end = 0;
+	int x = 0, i = 0;
+
+	for (x = 0; x < columns; x++)
+	{
+		first = x * bins / columns;
+		end = (x + 1) * bins / columns;
+		if (end <= first)
+			end = first + 1;
+
+		power = s->power[channel][first];
+		peak = s->peak[channel][first];
+		for (i = first + 1; i < end; i++)
+		{
+			if (s->power[channel][i] > power)
+				power = s->power[channel][i];
+			if (s->peak[channel][i] > peak)
+				peak = s->peak[channel][i];
+		}
+		db[x] = power_db(power);
+		peak_db[x] = power_db(peak);
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include "fft.h"
+#include "trigger.h"
+
+#define SPECTRUM_BINS               (FFT_MAX_SIZE / 2 + 1)
+#define SPECTRUM_MAX_AVERAGES       64
+#define SPECTRUM_FULL_SCALE         2048.0                  // amplitude of a sine that spans the ADC
+#define SPECTRUM_FLOOR_DB           -200.0                  // reported for a bin with no energy at all
+
+// Spectra of the enabled channels, one frame of size samples at a time.
+// Frames do not overlap: a new one is taken once size fresh samples have
+// been captured, always from the newest samples, so a slow consumer drops
+// frames instead of falling behind the capture.
+typedef struct spectrum
+{
+	fft_plan plan;
+	int size;
+	int averages;                                           // frames in the exponential average, 1 for none
+	int peak_hold;
+	unsigned int last;                                      // capture count at the last frame
+	int frames;                                             // frames since the last reset, up to averages
+	float frame[FFT_MAX_SIZE];
+	float bins[SPECTRUM_BINS];
+	float power[CAPTURE_CHANNELS][SPECTRUM_BINS];           // averaged
+	float peak[CAPTURE_CHANNELS][SPECTRUM_BINS];
+} spectrum;
+
+int spectrum_init(spectrum* s, int size, int averages, int peak_hold);
+void spectrum_free(spectrum* s);
+void spectrum_reset(spectrum* s, capture* c);
+int spectrum_poll(spectrum* s, capture* c, int channel_mask);
+void spectrum_columns(spectrum* s, int channel, int columns, float db[], float peak_db[]);
+
+#endif
@@ -0,0 +1,120 @@
+#include <string.h>
+#include "trigger.h"
+
+#define DEFAULT_LEVEL               2048
+#define DEFAULT_HYSTERESIS          64
+#define DEFAULT_PRETRIGGER          50
+
+void trigger_init(trigger* t)
+{
+	memset(t, 0, sizeof(trigger));
+	t->level = DEFAULT_LEVEL;
+	t->hysteresis = DEFAULT_HYSTERESIS;
+	t->edge = EDGE_RISING;
+	t->pretrigger = DEFAULT_PRETRIGGER;
+	t->mode = MODE_AUTO;
+}
+
+// Forgets any pending trigger and the history before now, for a new
+// acquisition (after a rate change) or a new single shot.
+void trigger_rearm(trigger* t, capture* c)
+{
+	t->start = c->count;
+	t->search = c->count;
+	t->last_frame = c->count;
+	t->pending = 0;
+	t->armed_rising = 0;
+	t->armed_falling = 0;
+	t->done = 0;
+}
+
+// Schmitt trigger: an edge arms once the signal is hysteresis past the
+// level on the far side, and fires when it then reaches the level.
+static int crossed(trigger* t, int sample)
+{
+	int fired = 0;
+
+	if (sample <= t->level - t->hysteresis)
+		t->armed_rising = 1;
+	if (sample >= t->level + t->hysteresis)
+		t->armed_falling = 1;
+
+	if (t->edge != EDGE_FALLING && t->armed_rising && sample >= t->level)
+		fired = 1;
+	if (t->edge != EDGE_RISING && t->armed_falling && sample <= t->level)
+		fired = 1;
+
+	if (fired)
+	{
+		t->armed_rising = 0;
+		t->armed_falling = 0;
+	}
+	return fired;
+}
+
+// Scans the samples captured since the last call. Returns 1 when a window
+// of width samples is ready, with its first sample in window_start and
+// whether a trigger placed it in triggered. The capture keeps running, so
+// the window must be copied out before CAPTURE_SIZE - width more samples
+// are pushed.
+int trigger_poll(trigger* t, capture* c, int width, unsigned int* window_start, int* triggered)
+{
+	unsigned int pre = width * t->pretrigger / 100;
+	unsigned int post = width - pre;
+
+	if (t->mode == MODE_SINGLE && t->done)
+		return 0;
+
+	// Never look at samples the capture has already overwritten
+	if (c->count - t->search > CAPTURE_SIZE - width)
+		t->search = c->count - (CAPTURE_SIZE - width);
+
+	while (!t->pending && t->search != c->count)
+	{
+		// A trigger needs the whole pre-trigger part of the window behind it
+		if (crossed(t, capture_sample(c, t->source, t->search)) && t->search - t->start >= pre)
+		{
+			t->pending = 1;
+			t->trigger_at = t->search;
+		}
+		t->search++;
+	}
+
+	if (t->pending && c->count - t->trigger_at >= post)
+	{
+		*window_start = t->trigger_at - pre;
+		*triggered = 1;
+		t->pending = 0;
+		// Hold off until the end of this window
+		t->search = t->trigger_at + post;
+		t->last_frame = c->count;
+		t->done = (t->mode == MODE_SINGLE);
+		return 1;
+	}
+
+	if (t->mode == MODE_AUTO && !t->pending &&
+	    c->count - t->last_frame >= AUTO_TIMEOUT_SWEEPS * (unsigned int) width &&
+	    c->count - t->start >= (unsigned int) width)
+	{
+		*window_start = c->count - width;
+		*triggered = 0;
+		t->last_frame = c->count;
+		return 1;
+	}
+
+	return 0;
+}
+
+const char* trigger_mode_name(trigger_mode mode)
+{
+	static const char* names[TRIGGER_MODES] = {"AUTO", "NORMAL", "SINGLE"};
+
+	return names[mode];
+}
+
+const char* trigger_edge_name(trigger_edge edge)
+{
+	static const char* names[] = {"rising", "falling", "either"};
+
+	return names[edge];
+}
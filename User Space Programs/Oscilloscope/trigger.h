@@ -0,0 +1,49 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include "capture.h"
+
+#define AUTO_TIMEOUT_SWEEPS         2                       // auto mode free-runs after this long without a trigger
+
+typedef enum trigger_edge
+{
+	EDGE_RISING,
+	EDGE_FALLING,
+	EDGE_EITHER
+} trigger_edge;
+
+typedef enum trigger_mode
+{
+	MODE_AUTO,                                              // trigger, or free-run when none comes
+	MODE_NORMAL,                                            // only triggered frames
+	MODE_SINGLE,                                            // one triggered frame, then wait for a re-arm
+	TRIGGER_MODES
+} trigger_mode;
+
+typedef struct trigger
+{
+	// Settings
+	int level;                                              // ADC counts
+	int hysteresis;                                         // the signal must swing this far past level to re-arm
+	trigger_edge edge;
+	int pretrigger;                                         // percent of the window before the trigger
+	trigger_mode mode;
+	int source;                                             // channel the trigger watches
+
+	// State
+	unsigned int start;                                     // first sample of the current acquisition
+	unsigned int search;                                    // next sample to examine
+	unsigned int trigger_at;                                // sample that fired, while pending
+	unsigned int last_frame;                                // count when the last frame was handed out
+	int pending;                                            // fired, waiting for the post-trigger samples
+	int armed_rising, armed_falling;
+	int done;                                               // single shot taken
+} trigger;
+
+void trigger_init(trigger* t);
+void trigger_rearm(trigger* t, capture* c);
+int trigger_poll(trigger* t, capture* c, int width, unsigned int* window_start, int* triggered);
+const char* trigger_mode_name(trigger_mode mode);
+const char* trigger_edge_name(trigger_edge edge);
+
+#endif
@@ -13,6 +13,7 @@
 #define video_BYTES 8                                       // number of characters to read from /dev/video
 #define COMMAND_STR_SIZE 64
 #define ELEMENT_SIZE 3
+#define ELEMENT_SURFACE 0                                   // driver surface holding the element sprite
 
 #define ANIM_SPEED_FACT 2
 
@@ -30,6 +31,7 @@ void draw_line(int, int, int, int, char, char);
 void draw_frame(element*, int, int);
 void swap_int(int*, int*);
 void init_objects(element*, int);
+void upload_element_sprite(void);
 void init_object(element*);
 void move_objects(element*, int, int);
 int read_keys(int*, int*, element*, int, int);
@@ -93,6 +95,7 @@ int main(void)
 	
 	element* elements = (element*) calloc(n_elements, sizeof(element));
 	
+	upload_element_sprite();
 	init_objects(elements, n_elements);
 	draw_frame(elements, n_elements, check_display_lines(sw_FD));
 	
@@ -125,6 +128,8 @@ int main(void)
 	write (video_FD, "sync", COMMAND_STR_SIZE);
 	write (video_FD, "clear", COMMAND_STR_SIZE); 					// clear the screen
 	write (video_FD, "erase", COMMAND_STR_SIZE); 					// clear the screen
+	sprintf (command, "free %d", ELEMENT_SURFACE);
+	write (video_FD, command, COMMAND_STR_SIZE);
 	close (key_FD);
 	close (sw_FD);
 	close (video_FD);
@@ -258,12 +263,26 @@ void draw_frame(element* elements, int n_elements, int draw_lines)
 	// to always be drawn on top of everything else, even when lines
 	// and objects cross on top of each other.
 	for (i = 0; i < n_elements; i++) {
-		sprintf (command, "box %d,%d %d,%d %X\n", elements[i].x,
-           		elements[i].y, elements[i].x + ELEMENT_SIZE, elements[i].y + ELEMENT_SIZE, WHITE);
+		sprintf (command, "blit %d %d,%d\n", ELEMENT_SURFACE, elements[i].x, elements[i].y);
   		write (video_FD, command, COMMAND_STR_SIZE);
 	}
 }
 
+// Uploads the element box to the driver once, so that every frame
+// only needs a short blit command per element.
+void upload_element_sprite(void)
+{
+	char sprite_cmd[COMMAND_STR_SIZE * 2] = "";
+	int length = 0;
+	int i = 0;
+
+	length = sprintf (sprite_cmd, "surface %d %d,%d", ELEMENT_SURFACE, ELEMENT_SIZE + 1, ELEMENT_SIZE + 1);
+	for (i = 0; i < (ELEMENT_SIZE + 1) * (ELEMENT_SIZE + 1); i++)
+		length += sprintf (sprite_cmd + length, " %X", WHITE);
+
+	write (video_FD, sprite_cmd, length);
+}
+
 void init_objects(element* elements, int n_elements)
 {
 	int i = 0;